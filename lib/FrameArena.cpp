@@ -0,0 +1,125 @@
+/******************************************************************************
+ * Project:    Arduino LED Easy Animations
+ * File:       FrameArena.cpp
+ * Author:     Adarsh Rallabandi
+ * Created:    2026-10-18
+ * Updated:    2026-10-18
+ *
+ * Description:
+ *   This file implements the FrameArena class specified in FrameArena.h.
+ *
+ * License:
+ *   Licensed under GNU GPL. See LICENSE file for details.
+ *
+ ******************************************************************************/
+
+#include "FrameArena.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+Basic class functionality
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+FrameArena::FrameArena() : stats_() {}
+
+FrameArena::~FrameArena(){
+    std::lock_guard<std::mutex> guard(lock_);
+    freeAll();
+}
+
+void FrameArena::release(){
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stats_.bytesInUse != 0){
+        throw std::runtime_error("FrameArena::release() ERROR: " + std::to_string(stats_.bytesInUse) +
+        " bytes are still in use. Destroy or clear every frame allocated from the arena first.");
+    }
+    freeAll();
+}
+
+size_t FrameArena::trim(){
+    std::lock_guard<std::mutex> guard(lock_);
+    size_t freed = 0;
+    for (auto& list : freeLists_){
+        for (void* p : list.second){
+            ::operator delete(p, list.first.second, std::align_val_t(list.first.first));
+            blocks_.erase(p);
+            freed += list.first.second;
+        }
+    }
+    freeLists_.clear();
+    stats_.bytesReserved -= freed;
+    stats_.bytesFree = 0;
+    return freed;
+}
+
+ArenaStats FrameArena::getStats(){
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+void FrameArena::freeAll(){
+    for (auto& block : blocks_){
+        ::operator delete(block.first, block.second.second, std::align_val_t(block.second.first));
+    }
+    blocks_.clear();
+    freeLists_.clear();
+    stats_.bytesInUse = 0;
+    stats_.bytesReserved = 0;
+    stats_.bytesFree = 0;
+    stats_.peakBytesInUse = 0;
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
+std::pmr::memory_resource hooks
+@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment){
+    std::lock_guard<std::mutex> guard(lock_);
+    stats_.allocations++;
+
+    /* Frames of an animation are almost always the same size, so the best fit is usually an
+    exact match. Keys sort by alignment first, so lower_bound finds the smallest buffer of the
+    right alignment that is at least as big. Buffers more than twice the request are left
+    alone, so a downscaled frame cannot pin a full-size buffer. */
+    void* p;
+    size_t size;
+    auto found = freeLists_.lower_bound(std::make_pair(alignment, bytes));
+    if (found != freeLists_.end() && found->first.first == alignment && found->first.second / 2 <= bytes){
+        size = found->first.second;
+        p = found->second.back();
+        found->second.pop_back();
+        if (found->second.empty()){
+            freeLists_.erase(found);
+        }
+        stats_.reuses++;
+        stats_.bytesFree -= size;
+    } else{
+        size = bytes;
+        p = ::operator new(bytes, std::align_val_t(alignment));
+        blocks_[p] = std::make_pair(alignment, bytes);
+        stats_.upstreamAllocations++;
+        stats_.bytesReserved += bytes;
+    }
+
+    stats_.bytesInUse += size;
+    stats_.peakBytesInUse = std::max(stats_.peakBytesInUse, stats_.bytesInUse);
+    return p;
+}
+
+void FrameArena::do_deallocate(void* p, size_t, size_t){
+    std::lock_guard<std::mutex> guard(lock_);
+
+    /* The buffer may be bigger than what was asked for, so file it under its real size. */
+    std::pair<size_t, size_t> block = blocks_.at(p);
+    stats_.deallocations++;
+    stats_.bytesInUse -= block.second;
+    stats_.bytesFree += block.second;
+    freeLists_[block].push_back(p);
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept{
+    return this == &other;
+}
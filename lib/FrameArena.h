@@ -0,0 +1,118 @@
+/******************************************************************************
+ * Project:    Arduino LED Easy Animations
+ * File:       FrameArena.h
+ * Author:     Adarsh Rallabandi
+ * Created:    2026-10-18
+ * Updated:    2026-10-18
+ *
+ * Description:
+ *   This file defines the FrameArena class, a memory resource that hands out
+ *   pixel buffers for PNG and IndexedPNG objects. Buffers that are freed are kept
+ *   and reused for the next buffer that fits in them. Unused buffers can be given
+ *   back to the system with trim(), and everything at once with release().
+ *
+ * License:
+ *   Licensed under GNU GPL. See LICENSE file for details.
+ *
+ ******************************************************************************/
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Allocation counters of a FrameArena. */
+struct ArenaStats{
+    size_t allocations;         // buffers handed out
+    size_t deallocations;       // buffers given back
+    size_t reuses;              // allocations served from a previously freed buffer
+    size_t upstreamAllocations; // allocations that actually went to the system heap
+    size_t bytesInUse;          // bytes in buffers currently handed out, counting the whole reused buffer
+    size_t bytesReserved;       // bytes held from the system heap, in use or not
+    size_t bytesFree;           // bytes in freed buffers kept for reuse
+    size_t peakBytesInUse;      // highest bytesInUse since the last release
+};
+
+class FrameArena : public std::pmr::memory_resource{
+    public:
+        /**
+         * Default constructor. Creates an empty arena.
+         */
+        FrameArena();
+
+        /**
+         * Destructor. Gives every buffer back to the system heap. The arena must outlive
+         * every PNG or IndexedPNG allocated from it.
+         */
+        ~FrameArena();
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        /**
+         * Gives every buffer back to the system heap at once. Throws if any buffer is
+         * still in use, since freeing it would leave its PNG or IndexedPNG pointing at
+         * freed memory. Destroy or clear everything allocated from the arena first.
+         */
+        void release();
+
+        /**
+         * Gives every buffer that is not in use back to the system heap, keeping the ones
+         * still in use. Call it after frames shrink or go away, so buffers of a size that
+         * will not come back are not held on to.
+         * @return The number of bytes given back.
+         */
+        size_t trim();
+
+        /**
+         * Getter for allocation counters. Counters other than bytesReserved, bytesFree
+         * and peakBytesInUse keep counting across release().
+         * @return The counters of the arena.
+         */
+        ArenaStats getStats();
+
+    private:
+        /* ================
+           Member variables
+           ================ */
+        std::mutex lock_; // buffers may be allocated from several threads, e.g. by ConversionPipeline
+        std::map<std::pair<size_t, size_t>, std::vector<void*>> freeLists_; // (alignment, bytes) -> freed buffers, never empty
+        std::unordered_map<void*, std::pair<size_t, size_t>> blocks_; // every buffer taken from the heap -> (alignment, bytes)
+        ArenaStats stats_;
+
+        /* =================
+           Private functions
+           ================= */
+
+        /**
+         * Private helper function that frees every buffer taken from the heap and resets
+         * the byte counters. The caller must hold lock_.
+         */
+        void freeAll();
+
+        /**
+         * std::pmr::memory_resource interface. Reuses the smallest freed buffer with the same
+         * alignment that is big enough but at most twice the size asked for, otherwise takes
+         * a new one from the heap. Frames scaled down by up to half can then live in the
+         * buffers their larger versions used without holding on to much more than they need.
+         */
+        void* do_allocate(size_t bytes, size_t alignment) override;
+
+        /**
+         * std::pmr::memory_resource interface. Keeps the buffer for reuse.
+         */
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+        /**
+         * std::pmr::memory_resource interface. Arenas are only equal to themselves.
+         */
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+#endif
@@ -0,0 +1,332 @@
+/******************************************************************************
+ * Project:    Arduino LED Easy Animations
+ * File:       IndexedPNG.cpp
+ * Author:     Adarsh Rallabandi
+ * Created:    2026-10-18
+ * Updated:    2026-10-18
+ *
+ * Description:
+ *   This file implements the IndexedPNG class and Palette struct specified in
+ *   IndexedPNG.h.
+ *
+ * License:
+ *   Licensed under GNU GPL. See LICENSE file for details.
+ *
+ ******************************************************************************/
+
+#include "IndexedPNG.h"
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * Helper function that packs a Pixel into a single integer so it can be used as a key.
+ * @param p The pixel to pack.
+ * @return The RGBA values of p, 8 bits each.
+ */
+static uint32_t packRGBA(const Pixel& p){
+    return (p.red & 0xFF) << 24 | (p.green & 0xFF) << 16 | (p.blue & 0xFF) << 8 | (p.alpha & 0xFF);
+}
+
+/*@@@@@@@@@@@@@@@
+Palette functions
+@@@@@@@@@@@@@@@@@*/
+
+uint8_t Palette::indexOf(const Pixel& color){
+    uint32_t key = packRGBA(color);
+    auto found = lookup.find(key);
+    if (found != lookup.end()){
+        return found->second;
+    }
+
+    if (colors.size() >= 256){
+        throw std::runtime_error("Palette::indexOf() ERROR: Palette already has 256 colors. Use a palette per frame or a full-color PNG.");
+    }
+    uint8_t index = colors.size();
+    colors.emplace_back(color);
+    lookup[key] = index;
+    return index;
+}
+
+void Palette::truncate(size_t count){
+    while (colors.size() > count){
+        lookup.erase(packRGBA(colors.back()));
+        colors.pop_back();
+    }
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+Basic class functionality
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+IndexedPNG::IndexedPNG() : width_(0), height_(0), bitDepth_(8), rowBytes_(0), palette_(new Palette()) {}
+
+IndexedPNG::IndexedPNG(PNG& source, std::shared_ptr<Palette> palette, std::pmr::memory_resource* resource)
+    : palette_(palette), indices_(resource) {
+    if (!palette_){
+        palette_.reset(new Palette());
+    }
+    width_ = source.getWidth();
+    height_ = source.getHeight();
+
+    /* Look every pixel up in the palette first, then pick the smallest bit depth that can
+    hold all of the indices. Neighbouring pixels are usually the same color, so the last
+    lookup is remembered to skip the hash map most of the time. If the palette fills up,
+    take this image's colors back out so other images sharing it are unaffected. */
+    std::pmr::vector<uint8_t> full(width_*height_, 0, indices_.get_allocator());
+    uint32_t lastKey = 0;
+    uint8_t lastIndex = 0;
+    bool haveLast = false;
+    size_t oldColors = palette_->colors.size();
+    try{
+        for (unsigned y=0; y < height_; y++){
+            for (unsigned x=0; x < width_; x++){
+                Pixel& curr = source.getPixel(x,y);
+                uint32_t key = packRGBA(curr);
+                if (!haveLast || key != lastKey){
+                    lastIndex = palette_->indexOf(curr);
+                    lastKey = key;
+                    haveLast = true;
+                }
+                full[x + y*width_] = lastIndex;
+            }
+        }
+    } catch (...){
+        palette_->truncate(oldColors);
+        throw;
+    }
+
+    bitDepth_ = 8;
+    rowBytes_ = width_;
+    indices_ = std::move(full);
+    if (palette_->colors.size() <= 16){
+        setBitDepth(4);
+    }
+}
+
+IndexedPNG::IndexedPNG(const IndexedPNG& other, std::pmr::memory_resource* resource)
+    : width_(other.width_), height_(other.height_), bitDepth_(other.bitDepth_), rowBytes_(other.rowBytes_),
+      palette_(other.palette_), indices_(other.indices_, resource) {}
+
+unsigned IndexedPNG::getWidth(){return width_;}
+unsigned IndexedPNG::getHeight(){return height_;}
+unsigned IndexedPNG::getBitDepth(){return bitDepth_;}
+std::shared_ptr<Palette> IndexedPNG::getPalette(){return palette_;}
+size_t IndexedPNG::getByteSize(){return indices_.size();}
+
+uint8_t IndexedPNG::getIndex(unsigned x, unsigned y){
+    if (x >= width_ || y >= height_){
+        throw std::runtime_error("IndexedPNG::getIndex() ERROR: Specified coordinates (" + std::to_string(x) + ", " + std::to_string(y) +
+        ") are out of bounds. Image dimensions are (" + std::to_string(width_) + ", " + std::to_string(height_) + ").");
+    }
+
+    if (bitDepth_ == 8){
+        return indices_[x + y*rowBytes_];
+    }
+    uint8_t byte = indices_[x/2 + y*rowBytes_];
+    return x % 2 ? byte & 0x0F : byte >> 4;
+}
+
+Pixel IndexedPNG::getPixel(unsigned x, unsigned y){
+    return palette_->colors[getIndex(x,y)];
+}
+
+void IndexedPNG::setIndex(unsigned x, unsigned y, uint8_t index){
+    if (bitDepth_ == 8){
+        indices_[x + y*rowBytes_] = index;
+        return;
+    }
+    uint8_t& byte = indices_[x/2 + y*rowBytes_];
+    if (x % 2){
+        byte = (byte & 0xF0) | index;
+    } else{
+        byte = (byte & 0x0F) | index << 4;
+    }
+}
+
+void IndexedPNG::setBitDepth(unsigned depth){
+    if (depth == bitDepth_){
+        return;
+    }
+
+    /* Read everything out at the old depth, then write it back at the new one. */
+    std::vector<uint8_t> full(width_*height_);
+    for (unsigned y=0; y < height_; y++){
+        for (unsigned x=0; x < width_; x++){
+            full[x + y*width_] = getIndex(x,y);
+        }
+    }
+
+    bitDepth_ = depth;
+    rowBytes_ = depth == 8 ? width_ : (width_ + 1) / 2;
+    indices_.assign(rowBytes_*height_, 0);
+    for (unsigned y=0; y < height_; y++){
+        for (unsigned x=0; x < width_; x++){
+            setIndex(x, y, full[x + y*width_]);
+        }
+    }
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+File I/O related functions
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+PNG IndexedPNG::toPNG(){
+    PNG result(width_, height_);
+    for (unsigned y=0; y < height_; y++){
+        for (unsigned x=0; x < width_; x++){
+            result.getPixel(x,y) = palette_->colors[getIndex(x,y)];
+        }
+    }
+    return result;
+}
+
+void IndexedPNG::save(std::string filepath){
+    std::vector<Pixel>& colors = palette_->colors;
+    if (colors.empty()){
+        throw std::runtime_error("IndexedPNG::save() ERROR: Cannot save an image with an empty palette.");
+    }
+
+    FILE* f = fopen(filepath.c_str(), "wb");
+    if (!f){
+        throw std::runtime_error("IndexedPNG::save() ERROR: Could not open or create file for writing. Do we have write permissions?");
+    }
+
+    /* Everything that owns memory is set up before setjmp. A libpng error longjmps back to
+    it, which would skip the destructor of anything declared later, and objects changed
+    after setjmp have indeterminate values once it returns again. */
+
+    /* A 4-bit PNG can only have a 16 color palette, so a frame stored at 4 bits that shares
+    a palette that has since grown gets written at 8 bits. */
+    int outDepth = bitDepth_ == 4 && colors.size() <= 16 ? 4 : 8;
+
+    /* Copy the palette over, with a tRNS chunk only if some color is not fully opaque. */
+    std::vector<png_color> plte(colors.size());
+    std::vector<png_byte> trans(colors.size());
+    int transCount = 0;
+    for (size_t i=0; i < colors.size(); i++){
+        plte[i].red = colors[i].red, plte[i].green = colors[i].green, plte[i].blue = colors[i].blue;
+        trans[i] = colors[i].alpha;
+        if (colors[i].alpha != 255){
+            transCount = i + 1;
+        }
+    }
+
+    /* Rows are already laid out the way libpng wants them at our own depth. Only a 4-bit
+    image written at 8 bits needs to be expanded, one row at a time, into this buffer. */
+    std::vector<png_byte> row((unsigned) outDepth == bitDepth_ ? 0 : width_);
+
+    /* Create structs to write the information to our png. */
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    if (!png || !info){
+        png_destroy_write_struct(&png, &info);
+        fclose(f);
+        throw std::runtime_error("IndexedPNG::save() ERROR: Failed to create PNG write struct.");
+    }
+    if (setjmp(png_jmpbuf(png))){
+        png_destroy_write_struct(&png, &info);
+        fclose(f);
+        throw std::runtime_error("IndexedPNG::save() ERROR: setjmp did not return 0.");
+    }
+
+    png_init_io(png, f);
+    png_set_IHDR(png, info, width_, height_, outDepth, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_PLTE(png, info, plte.data(), plte.size());
+    if (transCount){
+        png_set_tRNS(png, info, trans.data(), transCount, nullptr);
+    }
+    png_write_info(png, info);
+
+    for (unsigned j=0; j < height_; j++){
+        if ((unsigned) outDepth == bitDepth_){
+            png_write_row(png, &indices_[j*rowBytes_]);
+        } else{
+            for (unsigned i=0; i < width_; i++){
+                row[i] = getIndex(i,j);
+            }
+            png_write_row(png, row.data());
+        }
+    }
+    png_write_end(png, nullptr);
+
+    png_destroy_write_struct(&png, &info);
+    fclose(f);
+}
+
+/*@@@@@@@@@@@@@@@@
+Image manipulation
+@@@@@@@@@@@@@@@@@@*/
+
+void IndexedPNG::scale(unsigned newX, unsigned newY){
+    /* Handle 0 case. */
+    if (newX == 0 || newY == 0){
+        throw std::runtime_error("IndexedPNG::scale() ERROR: New dimensions must be greater than 0. Provided dimensions were (" + std::to_string(newX)
+        + ", " + std::to_string(newY) + ").");
+    }
+
+    /* Calculate the scale factors exactly like PNG::scale so both give the same image. The
+    source column of every new column only depends on x, so work it out once. */
+    float scaleX = (float) newX / (float) width_;
+    float scaleY = (float) newY / (float) height_;
+    std::vector<unsigned> sourceXs(newX);
+    for (unsigned x=0; x < newX; x++){
+        sourceXs[x] = std::min((unsigned) (x/scaleX), width_ - 1);
+    }
+
+    size_t newRowBytes = bitDepth_ == 8 ? newX : (newX + 1) / 2;
+    std::pmr::vector<uint8_t> newIndices(newRowBytes*newY, 0, indices_.get_allocator());
+
+    /* Rows that map to the same source row are identical, so copy the previous one instead. */
+    unsigned prevSourceY = height_;
+    for (unsigned y=0; y < newY; y++){
+        uint8_t* row = &newIndices[y*newRowBytes];
+        unsigned sourceY = std::min((unsigned) (y/scaleY), height_ - 1);
+        if (sourceY == prevSourceY){
+            std::copy(row - newRowBytes, row, row);
+            continue;
+        }
+        for (unsigned x=0; x < newX; x++){
+            uint8_t index = getIndex(sourceXs[x], sourceY);
+            if (bitDepth_ == 8){
+                row[x] = index;
+            } else{
+                row[x/2] |= x % 2 ? index : index << 4;
+            }
+        }
+        prevSourceY = sourceY;
+    }
+
+    /* Update member variables. */
+    indices_.swap(newIndices);
+    width_ = newX;
+    height_ = newY;
+    rowBytes_ = newRowBytes;
+}
+
+void IndexedPNG::binarify(Pixel colorA, Pixel colorB){
+    /* Binarify the palette itself as a 1-pixel tall PNG. That keeps the decision identical to
+    PNG::binarify while only comparing each color once. */
+    std::vector<Pixel>& colors = palette_->colors;
+    PNG swatch(colors.size(), 1);
+    for (size_t i=0; i < colors.size(); i++){
+        swatch.getPixel(i,0) = colors[i];
+    }
+    swatch.binarify(colorA, colorB);
+
+    /* Build an old index -> new index table. Adding A and B may grow the palette. */
+    uint8_t indexA = palette_->indexOf(colorA);
+    uint8_t indexB = palette_->indexOf(colorB);
+    std::vector<uint8_t> remap(swatch.getWidth());
+    for (size_t i=0; i < remap.size(); i++){
+        remap[i] = swatch.getPixel(i,0) == colorA ? indexA : indexB;
+    }
+    if (bitDepth_ == 4 && std::max(indexA, indexB) >= 16){
+        setBitDepth(8);
+    }
+
+    for (unsigned y=0; y < height_; y++){
+        for (unsigned x=0; x < width_; x++){
+            setIndex(x, y, remap[getIndex(x,y)]);
+        }
+    }
+}
@@ -0,0 +1,179 @@
+/******************************************************************************
+ * Project:    Arduino LED Easy Animations
+ * File:       IndexedPNG.h
+ * Author:     Adarsh Rallabandi
+ * Created:    2026-10-18
+ * Updated:    2026-10-18
+ *
+ * Description:
+ *   This file defines the IndexedPNG class and Palette struct, which store an
+ *   image as a color palette plus one 8-bit or 4-bit index per pixel instead of
+ *   full RGBA Pixels. Purpose of class is to keep long animations with few
+ *   colors small in memory.
+ *
+ * License:
+ *   Licensed under GNU GPL. See LICENSE file for details.
+ *
+ ******************************************************************************/
+
+#ifndef INDEXED_PNG_H
+#define INDEXED_PNG_H
+
+#include "PNG.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+/* Up to 256 colors that IndexedPNG indices refer to. A palette may be shared between
+many images (for example every frame of an animation). Not thread-safe. */
+struct Palette{
+    std::vector<Pixel> colors;
+    std::unordered_map<uint32_t, uint8_t> lookup; // packed RGBA -> index into colors
+
+    /**
+     * Finds a color in the palette, adding it if it is not there yet.
+     * @param color The color to look for.
+     * @return The index of the color.
+     */
+    uint8_t indexOf(const Pixel& color);
+
+    /**
+     * Removes the colors added after the palette had count colors.
+     * @param count The number of colors to keep.
+     */
+    void truncate(size_t count);
+};
+
+class IndexedPNG{
+    public:
+        /**
+         * Default constructor. Creates an empty image with its own empty palette.
+         */
+        IndexedPNG();
+
+        /**
+         * Conversion constructor. Creates an indexed copy of a full-color image. Every
+         * distinct color of source is added to the palette. Indices are stored with 4 bits
+         * per pixel if the palette has at most 16 colors afterwards, otherwise 8 bits. If the
+         * palette runs out of colors, the colors this image added are removed again before
+         * the error is thrown, so a shared palette is left as it was.
+         * @param source The image to convert.
+         * @param palette The palette to use. If null, the image gets a palette of its own.
+         * @param resource Where index memory comes from, e.g. a FrameArena. Defaults to the heap.
+         * @return An IndexedPNG with the same pixels as source.
+         */
+        IndexedPNG(PNG& source, std::shared_ptr<Palette> palette = nullptr, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        /**
+         * Copy constructor into a specific memory resource. The indices are copied as they
+         * are, so the bit depth is kept and the palette stays shared with other.
+         * @param other The image to copy.
+         * @param resource Where index memory comes from, e.g. a FrameArena.
+         * @return A copy of other whose indices live in resource.
+         */
+        IndexedPNG(const IndexedPNG& other, std::pmr::memory_resource* resource);
+
+        /**
+         * Width access operator.
+         * @return The width of the image.
+         */
+        unsigned getWidth();
+
+        /**
+         * Height access operator.
+         * @return The height of the image.
+         */
+        unsigned getHeight();
+
+        /**
+         * Bit depth access operator.
+         * @return The number of bits each index takes, 4 or 8.
+         */
+        unsigned getBitDepth();
+
+        /**
+         * Palette access operator.
+         * @return The palette the indices refer to.
+         */
+        std::shared_ptr<Palette> getPalette();
+
+        /**
+         * Memory used by the pixel indices, not counting the palette.
+         * @return The size of the index buffer in bytes.
+         */
+        size_t getByteSize();
+
+        /**
+         * Index access operator.
+         * @param x,y The coordinates of the desired pixel. Must be in-bounds.
+         * @return The palette index of the pixel.
+         */
+        uint8_t getIndex(unsigned x, unsigned y);
+
+        /**
+         * Pixel access operator. Unlike PNG::getPixel, this returns a copy since pixels are
+         * not stored as Pixels.
+         * @param x,y The coordinates of the desired pixel. Must be in-bounds.
+         * @return The color of the pixel.
+         */
+        Pixel getPixel(unsigned x, unsigned y);
+
+        /**
+         * Resizes and scales the image using the same nearest-neighbour mapping as
+         * PNG::scale, but only moves indices around.
+         * @param newX, newY The new dimensions of the image. Must be greater than 0.
+         */
+        void scale(unsigned newX, unsigned newY);
+
+        /**
+         * Changes all pixels into one of two colors. Same result as PNG::binarify, but the
+         * distance comparison is done once per palette entry instead of once per pixel.
+         * colorA and colorB are added to the palette if needed. A shared palette is never
+         * modified otherwise, so other images using it are unaffected.
+         * @param colorA, colorB The two colors you wish to use for the binarify operation
+         */
+        void binarify(Pixel colorA, Pixel colorB);
+
+        /**
+         * Expands the image back into a full-color PNG.
+         * @return A PNG with the same pixels.
+         */
+        PNG toPNG();
+
+        /**
+         * Creates a paletted PNG file from the image using libpng. 4-bit indices are
+         * written as-is when the palette fits in 16 colors, otherwise 8-bit.
+         * @param filepath A string with the exact or relative file path to a real .png file
+         */
+        void save(std::string filepath);
+
+    private:
+        /* ================
+           Member variables
+           ================ */
+        unsigned width_;
+        unsigned height_;
+        unsigned bitDepth_; // 4 or 8
+        size_t rowBytes_;   // every row starts on a byte boundary, like PNG rows do
+        std::shared_ptr<Palette> palette_;
+        std::pmr::vector<uint8_t> indices_; // row-major order, 4-bit indices packed high nibble first
+
+        /* =================
+           Private functions
+           ================= */
+
+        /**
+         * Private helper function that writes an index without bounds checking.
+         * @param x,y The coordinates of the pixel.
+         * @param index The palette index to store. Must fit in bitDepth_ bits.
+         */
+        void setIndex(unsigned x, unsigned y, uint8_t index);
+
+        /**
+         * Private helper function that repacks the indices with a new bit depth.
+         * @param depth 4 or 8.
+         */
+        void setBitDepth(unsigned depth);
+};
+
+#endif
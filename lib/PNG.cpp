@@ -3,7 +3,7 @@
  * File:       PNG.cpp
  * Author:     Adarsh Rallabandi
  * Created:    2024-12-30
- * Updated:    2024-12-31
+ * Updated:    2026-10-18
  *
  * Description:
  *   This file implements the PNG class and Pixel struct specified in PNG.h,
@@ -19,6 +19,9 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <stdexcept>
 
 /*@@@@@@@@@@@@@
@@ -34,14 +37,32 @@ Pixel functions
  * @return The Euclidian distance
  */
 float euclidianDistance(std::vector<unsigned> pointA, std::vector<unsigned> pointB){
-    return sqrt(pow(pointA[0] - pointB[0], 2) + pow(pointA[1] - pointB[1], 2) + pow(pointA[2] - pointB[2], 2) + pow(pointA[3] - pointB[3], 2));
+    // subtract as floats, since unsigned subtraction wraps around whenever pointA < pointB
+    float d0 = (float) pointA[0] - pointB[0], d1 = (float) pointA[1] - pointB[1];
+    float d2 = (float) pointA[2] - pointB[2], d3 = (float) pointA[3] - pointB[3];
+    return sqrt(d0*d0 + d1*d1 + d2*d2 + d3*d3);
 }
 
+/**
+ * Helper function for PNG::dither(). 8x8 Bayer matrix used as per-pixel thresholds for
+ * ordered dithering. Entries are 0 to 63 and get scaled up to the 0 to 255 tone range.
+ */
+static const unsigned char BAYER_8X8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
 /*@@@@@@@@@@@@@@@@@@@@@@@
 Basic class functionality
 @@@@@@@@@@@@@@@@@@@@@@@@@*/
 
-PNG::PNG(unsigned w, unsigned h){
+PNG::PNG(unsigned w, unsigned h, std::pmr::memory_resource* resource) : pixels_(resource) {
     width_ = w;
     height_ = h;
 
@@ -55,10 +76,44 @@ PNG::PNG(std::string filepath){
     readFromFile(filepath);
 }
 
-PNG::PNG(PNG& other){
+PNG::PNG(const std::vector<unsigned char>& bytes, std::pmr::memory_resource* resource) : pixels_(resource) {
+    readFromMemory(bytes);
+}
+
+PNG::PNG(const PNG& other){
+    width_ = other.width_;
+    height_ = other.height_;
+    pixels_ = other.pixels_;
+}
+
+PNG::PNG(const PNG& other, std::pmr::memory_resource* resource) : pixels_(other.pixels_, resource) {
+    width_ = other.width_;
+    height_ = other.height_;
+}
+
+PNG::PNG(PNG&& other) noexcept : width_(other.width_), height_(other.height_), pixels_(std::move(other.pixels_)) {
+    other.width_ = 0;
+    other.height_ = 0;
+}
+
+PNG& PNG::operator=(const PNG& other){
     width_ = other.width_;
     height_ = other.height_;
     pixels_ = other.pixels_;
+    return *this;
+}
+
+PNG& PNG::operator=(PNG&& other){
+    width_ = other.width_;
+    height_ = other.height_;
+    pixels_ = std::move(other.pixels_);
+    other.width_ = 0;
+    other.height_ = 0;
+    return *this;
+}
+
+std::pmr::memory_resource* PNG::getResource(){
+    return pixels_.get_allocator().resource();
 }
 
 unsigned PNG::getWidth(){
@@ -86,6 +141,28 @@ void PNG::save(std::string filepath){
     writeToFile(filepath);
 }
 
+/**
+ * Helper for PNG::readFromMemory(). Tracks how far into the buffer libpng has read.
+ */
+struct MemoryReader{
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+};
+
+/**
+ * libpng read callback for PNG::readFromMemory(). Copies the next length bytes out of
+ * the MemoryReader set as the io pointer.
+ */
+static void readFromMemoryCallback(png_structp png, png_bytep out, png_size_t length){
+    MemoryReader* reader = (MemoryReader*) png_get_io_ptr(png);
+    if (reader->pos + length > reader->size){
+        png_error(png, "Read past the end of the PNG buffer.");
+    }
+    memcpy(out, reader->data + reader->pos, length);
+    reader->pos += length;
+}
+
 void PNG::readFromFile(std::string filepath){
     FILE* f = fopen(filepath.c_str(), "rb");
     if (!f){
@@ -100,44 +177,88 @@ void PNG::readFromFile(std::string filepath){
         throw std::runtime_error("PNG::readFromFile() ERROR: Failed to create PNG read struct.");
     }
     if (setjmp(png_jmpbuf(png))){
+        png_destroy_read_struct(&png, &info, nullptr);
         fclose(f);
         throw std::runtime_error("PNG::readFromFile() ERROR: setjmp did not return 0.");
     }
     
-    /* Set our PNG struct's source file to f and read the info from f into our info struct. */
+    /* Set our PNG struct's source file to f and read the image. */
     png_init_io(png, f);
+    readImageData(png, info, true);
+
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(f);
+}
+
+void PNG::readFromMemory(const std::vector<unsigned char>& bytes){
+    if (bytes.size() < 8 || png_sig_cmp(bytes.data(), 0, 8)){
+        throw std::runtime_error("PNG::readFromMemory() ERROR: Buffer does not contain a PNG image.");
+    }
+
+    /* Create structs for reading the information from our PNG. */
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    if (!png || !info){
+        throw std::runtime_error("PNG::readFromMemory() ERROR: Failed to create PNG read struct.");
+    }
+    if (setjmp(png_jmpbuf(png))){
+        png_destroy_read_struct(&png, &info, nullptr);
+        throw std::runtime_error("PNG::readFromMemory() ERROR: setjmp did not return 0.");
+    }
+
+    /* Point libpng at our buffer instead of a file and read the image. */
+    MemoryReader reader = {bytes.data(), bytes.size(), 0};
+    png_set_read_fn(png, &reader, readFromMemoryCallback);
+    readImageData(png, info, false);
+
+    png_destroy_read_struct(&png, &info, nullptr);
+}
+
+void PNG::readImageData(png_structp png, png_infop info, bool verbose){
     png_read_info(png, info);
 
     /* Get dimensions from image and allocate necessary memory for pixels_ vector. */
     width_ = png_get_image_width(png, info);
     height_ = png_get_image_height(png, info);
-    std::cout << "PNG::readFromFile(): Image dimensions are (" << width_ << ", " << height_ << ")." << std::endl;
+    if (verbose){
+        std::cout << "PNG::readFromFile(): Image dimensions are (" << width_ << ", " << height_ << ")." << std::endl;
+    }
     pixels_.resize(width_*height_);
 
     /* Ensure that the image is 8-bit depth and of RGB or RGBA color type. */
     auto colorType = png_get_color_type(png, info);
     auto bitDepth = png_get_bit_depth(png, info);
     if (bitDepth == 16){
-        std::cout << "PNG was 16-bit depth. Stripping the second byte..." << std::endl;
+        if (verbose){
+            std::cout << "PNG was 16-bit depth. Stripping the second byte..." << std::endl;
+        }
         png_set_strip_16(png);
     }
     if (colorType == PNG_COLOR_TYPE_PALETTE){
-        std::cout << "PNG had palette color type. Setting to RGB..." << std::endl;
+        if (verbose){
+            std::cout << "PNG had palette color type. Setting to RGB..." << std::endl;
+        }
         png_set_palette_to_rgb(png);
     }
     if (colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8){
-        std::cout << "PNG had gray color type and bit depth less than 8. Correcting..." << std::endl;
+        if (verbose){
+            std::cout << "PNG had gray color type and bit depth less than 8. Correcting..." << std::endl;
+        }
         png_set_expand_gray_1_2_4_to_8(png);
     }
     if (png_get_valid(png, info, PNG_INFO_tRNS)){
         png_set_tRNS_to_alpha(png);
     }
     if (colorType == PNG_COLOR_TYPE_RGB || colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_PALETTE){
-        std::cout << "PNG did not have alpha channel. Filling with 0xff..." << std::endl;
+        if (verbose){
+            std::cout << "PNG did not have alpha channel. Filling with 0xff..." << std::endl;
+        }
         png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
     }
     if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA){
-        std::cout << "PNG had gray color type. Setting to RGB..." << std::endl;
+        if (verbose){
+            std::cout << "PNG had gray color type. Setting to RGB..." << std::endl;
+        }
         png_set_gray_to_rgb(png);
     }
 
@@ -146,24 +267,21 @@ void PNG::readFromFile(std::string filepath){
     /* Read the PNG image into an array of row pointers. Then, we can use those row pointers
     to get the RGBA information into the pixels_ array.*/
     png_bytep* imageByRows = new png_bytep[height_];
-    for (int j=0; j < height_; j++){
+    for (unsigned j=0; j < height_; j++){
         // each png_byte stores r, g, b, or a information. As such, we allocate 4 for each pixel.
-        imageByRows[j] = (png_byte*) malloc(png_get_rowbytes(png,info));
+        imageByRows[j] = new png_byte[png_get_rowbytes(png,info)];
     }
     png_read_image(png, imageByRows);
 
     // Copy over data from imageByRows to pixels_
-    for (int j = 0; j < height_; j++){
-        for (int i = 0; i < width_; i++){
+    for (unsigned j = 0; j < height_; j++){
+        for (unsigned i = 0; i < width_; i++){
             png_bytep currPx = &(imageByRows[j][i*4]); // create pointer to current 4 png_bytes
             pixels_[i + j*width_] = Pixel(currPx[0], currPx[1], currPx[2], currPx[3]);
         }
         delete[] imageByRows[j]; // save memory and delete the current row 
     }
     delete[] imageByRows; // delete entire imageByRows now that we are done with it
-
-    png_destroy_read_struct(&png, &info, nullptr);
-    fclose(f);
 }
 
 void PNG::writeToFile(std::string filepath){
@@ -225,27 +343,20 @@ void PNG::resize(unsigned newX, unsigned newY){
         + ", " + std::to_string(newY) + ").");
     }
 
-    /* Just call calloc to allocate more memory and reinitialize pixels. */
-    std::vector<Pixel> newPixels;
-    newPixels.resize(newX*newY);
+    /* Allocate the new canvas from the same memory resource as the current one. */
+    std::pmr::vector<Pixel> newPixels(newX*newY, Pixel(), pixels_.get_allocator());
 
     if (newX < width_ || newY < height_){
         std::cout << "PNG is being resized to smaller dimensions. Some image data will be lost." << std::endl;
-
-        for (unsigned i=0; i < newX; i++){
-            for (unsigned j=0; j < newY; j++){
-                newPixels[i + j*newX] = getPixel(i,j);
-            }
-        }
-    } else{
-        for (unsigned i=0; i < width_; i++){
-            for (unsigned j=0; j < height_; j++){
-                newPixels[i + j*newX] = getPixel(i,j);
-            }
+    }
+    for (unsigned i=0; i < std::min(newX, width_); i++){
+        for (unsigned j=0; j < std::min(newY, height_); j++){
+            newPixels[i + j*newX] = getPixel(i,j);
         }
     }
 
-    /* Update width_ and height_ */
+    /* Update width_ and height_ and hand the old canvas back to the memory resource. */
+    pixels_.swap(newPixels);
     width_ = newX;
     height_ = newY;
 }
@@ -257,9 +368,8 @@ void PNG::scale(unsigned newX, unsigned newY){
         + ", " + std::to_string(newY) + ").");
     }
 
-    /* Create new pixel array with new dimensions. */
-    std::vector<Pixel> newPixels;
-    newPixels.resize(newX*newY);
+    /* Create new pixel array with new dimensions, from the same memory resource as the current one. */
+    std::pmr::vector<Pixel> newPixels(newX*newY, Pixel(), pixels_.get_allocator());
 
     /* Calculate the scale factors to ensure that new image scales correctly. */
     float scaleX = (float) newX / (float) width_;
@@ -278,16 +388,13 @@ void PNG::scale(unsigned newX, unsigned newY){
         }
     }
 
-    /* Update member variables. */
-    pixels_ = newPixels;
+    /* Update member variables. Swapping hands the old buffer back to the memory resource
+    instead of copying, so a FrameArena can reuse it for the next frame's scale. */
+    pixels_.swap(newPixels);
     width_ = newX;
     height_ = newY;
 }
 
-/**@todo
- * Sometimes creating weird artifacts, especially on
- * bad apple images. This causes distortion at lower resolutions.
- */
 void PNG::binarify(Pixel colorA, Pixel colorB){
     /* Create vector representations of Pixels. */
     std::vector<unsigned> vecA = {colorA.red, colorA.green, colorA.blue, colorA.alpha};
@@ -311,4 +418,78 @@ void PNG::binarify(Pixel colorA, Pixel colorB){
             }
         }
     }
-}
\ No newline at end of file
+}
+
+void PNG::dither(Pixel colorA, Pixel colorB, DitherMode mode, PNG* previous, unsigned stability){
+    if (previous && (previous->width_ != width_ || previous->height_ != height_)){
+        throw std::runtime_error("PNG::dither() ERROR: Previous frame dimensions (" + std::to_string(previous->width_) + ", " +
+        std::to_string(previous->height_) + ") do not match image dimensions (" + std::to_string(width_) + ", " + std::to_string(height_) + ").");
+    }
+
+    /* Every pixel is reduced to a tone between 0 (exactly B) and 255 (exactly A) by projecting
+    it onto the line from B to A. Only the denominator depends on A and B, so it is done once. */
+    int axis[4] = {(int) colorA.red - (int) colorB.red, (int) colorA.green - (int) colorB.green,
+                   (int) colorA.blue - (int) colorB.blue, (int) colorA.alpha - (int) colorB.alpha};
+    long long axisLength = (long long) axis[0]*axis[0] + (long long) axis[1]*axis[1] + (long long) axis[2]*axis[2] + (long long) axis[3]*axis[3];
+    if (axisLength == 0){ // A and B are the same color, nothing to choose between
+        std::fill(pixels_.begin(), pixels_.end(), colorA);
+        return;
+    }
+
+    /* Error buffers, offset by one column so x-1 and x+1 never need bounds checks. Floyd-Steinberg
+    only needs the row below; Atkinson also pushes error two rows down. */
+    std::vector<int> nextRow(width_ + 2, 0);
+    std::vector<int> nextNextRow(mode == DITHER_ATKINSON ? width_ + 2 : 0, 0);
+
+    for (unsigned y=0; y < height_; y++){
+        int carry = 0;      // error pushed right from the previous pixel
+        int carry2 = 0;     // Atkinson: error pushed two pixels right
+        int downRight = 0;  // error for the pixel below and to the right of the previous one
+        for (unsigned x=0; x < width_; x++){
+            Pixel& curr = pixels_[x + y*width_];
+            long long dot = ((long long) curr.red - colorB.red)*axis[0] + ((long long) curr.green - colorB.green)*axis[1]
+                          + ((long long) curr.blue - colorB.blue)*axis[2] + ((long long) curr.alpha - colorB.alpha)*axis[3];
+            int tone = (int) std::max(0LL, std::min(255LL, dot*255 / axisLength));
+
+            /* Pick the threshold for this pixel and add any error diffused into it. */
+            int threshold = 128;
+            if (mode == DITHER_BAYER){
+                threshold = BAYER_8X8[y % 8][x % 8]*4 + 2;
+            } else if (mode == DITHER_FLOYD_STEINBERG || mode == DITHER_ATKINSON){
+                tone += carry + nextRow[x+1];
+            }
+
+            /* Close to the threshold, keep whatever the previous frame showed so pixels that
+            sit on the edge do not flicker. The error is still diffused either way, so the
+            overall tone is preserved. */
+            bool chooseA = tone >= threshold;
+            if (previous && std::abs(tone - threshold) <= (int) stability){
+                chooseA = previous->pixels_[x + y*width_] == colorA;
+            }
+            int err = tone - (chooseA ? 255 : 0);
+            curr = chooseA ? colorA : colorB;
+
+            if (mode == DITHER_FLOYD_STEINBERG){
+                /* 7/16 right, 3/16 down-left, 5/16 down, 1/16 down-right. nextRow[x+1] has been
+                read already, so it can now hold this column's error for the next row. nextRow[x+2]
+                has not, so down-right is held back until the next pixel. */
+                carry = err*7/16;
+                nextRow[x] += err*3/16;
+                nextRow[x+1] = err*5/16 + downRight;
+                downRight = err/16;
+            } else if (mode == DITHER_ATKINSON){
+                /* 1/8 to each of right, two right, down-left, down, down-right and two down. The
+                remaining 2/8 is dropped, which keeps contrast in flat areas. Down-right is held
+                back a pixel for the same reason as above. */
+                int share = err/8;
+                carry = carry2 + share;
+                carry2 = share;
+                nextRow[x] += share;
+                nextRow[x+1] = nextNextRow[x+1] + share + downRight;
+                nextNextRow[x+1] = share;
+                downRight = share;
+            }
+        }
+        nextRow[0] = 0; // down-left error of the first column falls off the image
+    }
+}
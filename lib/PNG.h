@@ -3,7 +3,7 @@
  * File:       PNG.h
  * Author:     Adarsh Rallabandi
  * Created:    2024-12-30
- * Updated:    2024-12-31
+ * Updated:    2026-10-18
  *
  * Description:
  *   This file defines the PNG class and Pixel struct, which provides functionality
@@ -15,7 +15,11 @@
  *
  ******************************************************************************/
 
+#ifndef PNG_CLASS_H
+#define PNG_CLASS_H
+
 #include <png.h>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
@@ -45,6 +49,14 @@ struct Pixel{
     }
 };
 
+/* Ways of reducing an image to two colors in PNG::dither(). */
+enum DitherMode{
+    DITHER_NONE,            // plain threshold, no dithering
+    DITHER_BAYER,           // ordered dithering with an 8x8 Bayer matrix
+    DITHER_FLOYD_STEINBERG, // error diffusion to 4 neighbours
+    DITHER_ATKINSON         // error diffusion to 6 neighbours, losing 1/4 of the error
+};
+
 class PNG{
     public:
         /**
@@ -52,9 +64,10 @@ class PNG{
          * allocates necessary memory for pixels_ vector.
          * @param w The desired width
          * @param h The desired height
+         * @param resource Where pixel memory comes from, e.g. a FrameArena. Defaults to the heap.
          * @return An empty PNG object
          */
-        PNG(unsigned w = 0, unsigned h = 0);
+        PNG(unsigned w = 0, unsigned h = 0, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
         /**
          * File constructor. Creates a PNG object given a file path using the supreme
@@ -65,11 +78,61 @@ class PNG{
         PNG(std::string filepath);
 
         /**
-         * Copy constructor. Creates a copy of another PNG object.
+         * Memory constructor. Creates a PNG object from the raw bytes of a .png file that
+         * has already been read into memory. Useful when file I/O and decoding happen
+         * on different threads. Unlike the file constructor, it prints nothing.
+         * @param bytes The complete contents of a .png file
+         * @param resource Where pixel memory comes from, e.g. a FrameArena. Defaults to the heap.
+         * @return A PNG object representing the provided bytes.
+         */
+        PNG(const std::vector<unsigned char>& bytes, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        /**
+         * Copy constructor. Creates a copy of another PNG object. The copy's pixels
+         * always come from the heap, so it stays valid after other's FrameArena is
+         * released.
          * @param other The other PNG object
          * @return A copy of other
          */
-        PNG(PNG& other);
+        PNG(const PNG& other);
+
+        /**
+         * Copy constructor with a memory resource. Creates a copy of another PNG object
+         * whose pixels come from resource.
+         * @param other The other PNG object
+         * @param resource Where pixel memory comes from, e.g. a FrameArena.
+         * @return A copy of other
+         */
+        PNG(const PNG& other, std::pmr::memory_resource* resource);
+
+        /**
+         * Move constructor. Takes over the pixels of other, including the memory resource
+         * they came from. Lets std::vector<PNG> grow without copying every frame.
+         * @param other The other PNG object. Left empty.
+         * @return The moved PNG
+         */
+        PNG(PNG&& other) noexcept;
+
+        /**
+         * Copy assignment operator. Pixels are copied into this image's own memory resource.
+         * @param other The other PNG object
+         * @return This PNG
+         */
+        PNG& operator=(const PNG& other);
+
+        /**
+         * Move assignment operator. Takes over the pixels of other if both use the same
+         * memory resource, otherwise copies them into this image's own.
+         * @param other The other PNG object
+         * @return This PNG
+         */
+        PNG& operator=(PNG&& other);
+
+        /**
+         * Memory resource access operator.
+         * @return Where this image's pixel memory comes from.
+         */
+        std::pmr::memory_resource* getResource();
 
         /**
          * Width access operator.
@@ -114,6 +177,19 @@ class PNG{
          */
         void binarify(Pixel colorA, Pixel colorB);
 
+        /**
+         * Changes all pixels into one of two colors like binarify, but dithers so that
+         * gradients survive as patterns of A and B instead of hard edges. Each pixel's
+         * position between B and A is computed with integer math only.
+         * @param colorA, colorB The two colors you wish to use for the dither operation
+         * @param mode The dithering algorithm to use.
+         * @param previous The previous frame of an animation, already dithered with the same
+         * colors, or null. Must have the same dimensions as this image.
+         * @param stability How close (out of 255) a pixel must be to its threshold to keep the
+         * color it had in previous instead. Higher values flicker less between frames.
+         */
+        void dither(Pixel colorA, Pixel colorB, DitherMode mode, PNG* previous = nullptr, unsigned stability = 0);
+
         /**
          * Creates a PNG file from the information of the object and stores image using
          * libpng writing capabilities.
@@ -127,7 +203,7 @@ class PNG{
            ================ */
         unsigned width_;
         unsigned height_;
-        std::vector<Pixel> pixels_; // row-major order
+        std::pmr::vector<Pixel> pixels_; // row-major order
 
         /* =================
            Private functions
@@ -140,6 +216,23 @@ class PNG{
          */
         void readFromFile(std::string filepath);
 
+        /**
+         * Private helper function for memory constructor. Same as readFromFile, but
+         * libpng reads from a buffer instead of a file.
+         * @param bytes The complete contents of a .png file
+         */
+        void readFromMemory(const std::vector<unsigned char>& bytes);
+
+        /**
+         * Private helper function shared by readFromFile and readFromMemory. Reads the
+         * header and pixels once libpng's input has been set up, converting everything
+         * to 8-bit RGBA.
+         * @param png, info The libpng read structs, with input already configured.
+         * @param verbose Whether to print the dimensions and format conversions. Only the file
+         * constructor does; memory decoding runs on pipeline threads whose output may be stdout.
+         */
+        void readImageData(png_structp png, png_infop info, bool verbose);
+
         /**
          * Private helper function for "save." Uses libpng to write to a PNG file with
          * values from member variables.
@@ -148,3 +241,4 @@ class PNG{
         void writeToFile(std::string filepath);
 };
 
+#endif
@@ -6,13 +6,13 @@
 Basic class functionality
 @@@@@@@@@@@@@@@@@@@@@@@@@*/
 
-Animation::Animation(size_t f) : fps_(f), sameDims_(true) {
+Animation::Animation(size_t f) : fps_(f), sameDims_(true), indexed_(false), ditherMode_(DITHER_NONE), ditherStability_(0) {
     if (f <= 0){
         throw std::runtime_error("Animation constructor ERROR: FPS cannot be less than or equal to 0.");
     }
 }
 
-Animation::Animation(size_t f, std::vector<PNG> famey, bool sd) : fps_(f), sameDims_(sd), frames_(famey) {
+Animation::Animation(size_t f, std::vector<PNG> famey, bool sd) : fps_(f), sameDims_(sd), frames_(famey), indexed_(false), ditherMode_(DITHER_NONE), ditherStability_(0) {
     if (f <= 0){
         throw std::runtime_error("Animation constructor ERROR: FPS cannot be less than or equal to 0.");
     }
@@ -34,12 +34,119 @@ void Animation::setFPS(size_t newFPS){
     fps_ = newFPS;
 }
 
-std::vector<PNG> Animation::getFrames(){return frames_;}
-std::vector<PNG>& Animation::getFramesRef(){return frames_;}
+std::vector<PNG> Animation::getFrames(){
+    if (!indexed_){
+        return frames_;
+    }
+    std::vector<PNG> expanded;
+    for (IndexedPNG& f : indexedFrames_){
+        expanded.emplace_back(f.toPNG());
+    }
+    return expanded;
+}
+
+std::vector<PNG>& Animation::getFramesRef(){
+    if (indexed_){
+        throw std::runtime_error("Animation::getFramesRef() ERROR: Frames are stored as indexed images. Use getIndexedFramesRef() instead.");
+    }
+    return frames_;
+}
+
+PNG Animation::getFrame(size_t i){
+    if (i >= getFrameCount()){
+        throw std::runtime_error("Animation::getFrame() ERROR: Frame " + std::to_string(i) + " is out of bounds. Animation has "
+        + std::to_string(getFrameCount()) + " frames.");
+    }
+    return indexed_ ? indexedFrames_[i].toPNG() : frames_[i];
+}
+
+size_t Animation::getFrameCount(){
+    return indexed_ ? indexedFrames_.size() : frames_.size();
+}
+
+bool Animation::isIndexed(){return indexed_;}
+DitherMode Animation::getDitherMode(){return ditherMode_;}
+
+void Animation::setDither(DitherMode mode, unsigned stability){
+    ditherMode_ = mode;
+    ditherStability_ = stability;
+}
+std::vector<IndexedPNG>& Animation::getIndexedFramesRef(){return indexedFrames_;}
+
+std::pmr::memory_resource* Animation::frameResource(){
+    return arena_ ? (std::pmr::memory_resource*) arena_.get() : std::pmr::get_default_resource();
+}
+
+std::shared_ptr<FrameArena> Animation::getArena(){return arena_;}
+
+void Animation::setArena(std::shared_ptr<FrameArena> arena){
+    std::shared_ptr<FrameArena> old = arena_; // keep the old arena alive until frames have left it
+    arena_ = arena;
+
+    /* Re-home existing frames in the new resource. Assigning into the old frames would keep
+    their old resource, so the vectors are rebuilt instead. */
+    std::vector<PNG> rehomed;
+    for (PNG& f : frames_){
+        rehomed.emplace_back(f, frameResource());
+    }
+    frames_.swap(rehomed);
+    std::vector<IndexedPNG> rehomedIndexed;
+    for (IndexedPNG& f : indexedFrames_){
+        rehomedIndexed.emplace_back(f, frameResource());
+    }
+    indexedFrames_.swap(rehomedIndexed);
+}
+
+void Animation::releaseFrames(){
+    frames_.clear();
+    frames_.shrink_to_fit();
+    indexedFrames_.clear();
+    indexedFrames_.shrink_to_fit();
+    if (palette_){
+        palette_ = std::make_shared<Palette>();
+    }
+    /* Only hand the arena's memory back if nothing else can still be using it: another
+    Animation or a ConversionPipeline sharing the arena may own live frames in it. */
+    if (arena_ && arena_.use_count() == 1 && arena_->getStats().bytesInUse == 0){
+        arena_->release();
+    } else if (arena_){
+        arena_->trim();
+    }
+}
+
+void Animation::setIndexed(bool indexed, bool sharedPalette){
+    /* Convert whatever frames we already have to the new representation. The new frames and
+    palette are built on the side and only swapped in once every frame has converted, so a
+    palette that runs out of colors halfway through leaves the animation as it was. */
+    if (indexed){
+        std::shared_ptr<Palette> palette = sharedPalette ? std::make_shared<Palette>() : nullptr;
+        std::vector<IndexedPNG> converted;
+        for (size_t i=0; i < getFrameCount(); i++){ // one frame at a time so indexed frames are not all expanded at once
+            PNG f = getFrame(i);
+            converted.emplace_back(f, palette, frameResource());
+        }
+        indexedFrames_.swap(converted);
+        frames_.clear();
+        palette_ = palette;
+    } else if (indexed_){
+        std::vector<PNG> converted;
+        for (IndexedPNG& f : indexedFrames_){
+            PNG full = f.toPNG();
+            converted.emplace_back(full, frameResource());
+        }
+        frames_.swap(converted);
+        indexedFrames_.clear();
+        palette_ = nullptr;
+    }
+    indexed_ = indexed;
+    if (arena_){ // the old representation's buffers are a different size
+        arena_->trim();
+    }
+}
 
 float Animation::getSize(){
     // 96 bits per frame, 8 bits in a byte
-    return (96*frames_.size()) / 8.000;
+    return (96*getFrameCount()) / 8.000;
 }
 
 /*@@@@@@@@@@@@@@
@@ -52,26 +159,34 @@ void Animation::addFrame(PNG myFrame){
     }
 
     /* If animation is empty, add frame and set the dimensions accordingly. If not, modify the frame to
-    match the dimensions of the other frames. */
-    if (frames_.empty()){
-        frames_.emplace_back(myFrame);
-        width_ = myFrame.getWidth();
-        height_ = myFrame.getHeight();
+    match the dimensions of the other frames. Work on a copy in frameResource() so the scaling
+    buffers come from the arena too. */
+    PNG frame(myFrame, frameResource());
+    if (getFrameCount() == 0){
+        width_ = frame.getWidth();
+        height_ = frame.getHeight();
     }
     else{
-        myFrame.scale(width_, height_);
-        frames_.emplace_back(myFrame);
+        frame.scale(width_, height_);
     }
+    storeFrame(frame);
 }
 
 void Animation::addFrameArd(PNG myFrame){
-    if (frames_.empty()){ // set dimensions for empty animation
+    if (getFrameCount() == 0){ // set dimensions for empty animation
         width_ = myFrame.getWidth();
         height_ = myFrame.getHeight();
     }
-    myFrame.scale(12, 8);
-    myFrame.binarify(BLACK, WHITE);
-    frames_.emplace_back(myFrame);
+    PNG frame(myFrame, frameResource()); // so the scaling buffers come from the arena too
+    frame.scale(12, 8);
+    if (getFrameCount() == 0){
+        reduceFrame(frame, nullptr);
+    } else{ // previous frame keeps dithered pixels from flickering
+        PNG previous = getFrame(getFrameCount() - 1);
+        bool comparable = previous.getWidth() == 12 && previous.getHeight() == 8;
+        reduceFrame(frame, comparable ? &previous : nullptr);
+    }
+    storeFrame(frame);
 
     // check if dimensions match and warn if they do not
     if ((width_ != 12 || height_ != 8) && sameDims_){
@@ -85,8 +200,9 @@ void Animation::addFrameArd(PNG myFrame){
 }
 
 void Animation::addFrameUnchanged(PNG myFrame){
-    frames_.emplace_back(myFrame);
-    if (frames_.empty()){
+    PNG frame(myFrame, frameResource());
+    storeFrame(frame);
+    if (getFrameCount() == 0){
         width_ = myFrame.getWidth();
         height_ = myFrame.getHeight();
     }
@@ -101,6 +217,22 @@ void Animation::addFrameUnchanged(PNG myFrame){
     }
 }
 
+void Animation::storeFrame(PNG& myFrame){
+    if (indexed_){
+        indexedFrames_.emplace_back(myFrame, palette_, frameResource());
+    } else{
+        frames_.emplace_back(std::move(myFrame));
+    }
+}
+
+void Animation::reduceFrame(PNG& myFrame, PNG* previous){
+    if (ditherMode_ == DITHER_NONE && (!previous || ditherStability_ == 0)){
+        myFrame.binarify(BLACK, WHITE);
+    } else{
+        myFrame.dither(BLACK, WHITE, ditherMode_, previous, ditherStability_);
+    }
+}
+
 std::vector<u_int32_t> Animation::frameToArduino(PNG myFrame, Pixel domColorA, Pixel domColorB){
     /* For safety, make sure the frame is in correct Arduino format. */
     myFrame.resize(12,8);
@@ -148,6 +280,15 @@ void Animation::scale(unsigned x, unsigned y){
     for (PNG& f : frames_){
         f.scale(x,y);
     }
+    for (IndexedPNG& f : indexedFrames_){
+        f.scale(x,y);
+    }
+
+    /* Buffers of the old size are unlikely to be asked for again, so give them back rather
+    than keep them in the arena. */
+    if (arena_){
+        arena_->trim();
+    }
 
     /* Update member variables.*/
     sameDims_ = true;
@@ -157,16 +298,38 @@ void Animation::scale(unsigned x, unsigned y){
 
 void Animation::arduinofy(){
     scale(12,8);
-    for (PNG& f : frames_){
-        f.binarify(BLACK, WHITE);
+    if (ditherMode_ == DITHER_NONE && ditherStability_ == 0){
+        for (PNG& f : frames_){
+            f.binarify(BLACK, WHITE);
+        }
+        for (IndexedPNG& f : indexedFrames_){
+            f.binarify(BLACK, WHITE);
+        }
+        return;
+    }
+
+    /* Frames are reduced in order so each one can look at the previous, already reduced one. */
+    for (size_t i=0; i < frames_.size(); i++){
+        reduceFrame(frames_[i], i ? &frames_[i-1] : nullptr);
+    }
+    PNG previous;
+    for (size_t i=0; i < indexedFrames_.size(); i++){
+        PNG curr = indexedFrames_[i].toPNG();
+        reduceFrame(curr, i ? &previous : nullptr);
+        indexedFrames_[i] = IndexedPNG(curr, palette_, frameResource());
+        previous = curr;
     }
 }
 
 std::vector<std::vector<u_int32_t>> Animation::animationToArduino(){
     std::vector<std::vector<u_int32_t>> sequence;
-    for (PNG f : getFrames()){
-        sequence.emplace_back(frameToArduino(f, BLACK, WHITE));
+    for (size_t i=0; i < getFrameCount(); i++){ // one frame at a time so indexed frames are not all expanded at once
+        sequence.emplace_back(frameToArduino(getFrame(i), BLACK, WHITE));
     }
 
     return sequence;
+}
+
+CompressedAnimation Animation::animationToArduinoCompressed(unsigned threshold, size_t maxLoopLength){
+    return compressFrames(animationToArduino(), threshold, maxLoopLength);
 }
\ No newline at end of file
@@ -1,4 +1,10 @@
+#ifndef ARDUINO_ANIMATION_H
+#define ARDUINO_ANIMATION_H
+
 #include "../lib/PNG.h"
+#include "../lib/IndexedPNG.h"
+#include "../lib/FrameArena.h"
+#include "frame-index.h"
 
 #define BLACK Pixel(0,0,0,255)
 #define WHITE Pixel(255,255,255,255)
@@ -29,7 +35,8 @@ class Animation{
         void setFPS(size_t newFPS);
 
         /**
-         * Getter for frames. This will create a copy.
+         * Getter for frames. This will create a copy. Indexed frames are expanded
+         * back to full color.
          * @return A vector containing the frames of the animation.
          */
         std::vector<PNG> getFrames();
@@ -37,10 +44,85 @@ class Animation{
         /**
          * Getter for frames. Since this is a reference, this
          * will allow for direct modification.
+         * Cannot be called while the animation stores indexed frames.
          * @return A reference to the frames_ vector of the Animation object.
          */
         std::vector<PNG>& getFramesRef();
 
+        /**
+         * Getter for a single frame. This will create a copy, expanded back to
+         * full color if the animation stores indexed frames.
+         * @param i The index of the frame. Must be in-bounds.
+         * @return The frame.
+         */
+        PNG getFrame(size_t i);
+
+        /**
+         * Getter for the number of frames, regardless of how they are stored.
+         * @return The number of frames in the animation.
+         */
+        size_t getFrameCount();
+
+        /**
+         * Makes the animation keep its frames in a FrameArena instead of allocating every
+         * frame (and every scale of every frame) separately on the heap. Existing frames
+         * are moved into the arena. The arena may be shared, e.g. with a ConversionPipeline.
+         * @param arena The arena to use, or null to go back to the heap.
+         */
+        void setArena(std::shared_ptr<FrameArena> arena);
+
+        /**
+         * Getter for the arena. Its getStats() shows how many allocations frames caused.
+         * @return The arena frames are kept in, or null if they are on the heap.
+         */
+        std::shared_ptr<FrameArena> getArena();
+
+        /**
+         * Removes every frame at once. If the animation has an arena that nothing else
+         * shares and that holds no other frames, all of its memory is given back to the
+         * system too. Otherwise only the arena's unused buffers are given back.
+         */
+        void releaseFrames();
+
+        /**
+         * Sets how frames are reduced to black and white by addFrameArd() and arduinofy().
+         * DITHER_NONE (the default) uses plain binarify.
+         * @param mode The dithering algorithm to use.
+         * @param stability How close (out of 255) a pixel must be to its threshold to keep
+         * its color from the previous frame. 0 disables this; larger values trade detail for
+         * less flicker between frames.
+         */
+        void setDither(DitherMode mode, unsigned stability = 0);
+
+        /**
+         * Getter for the dithering algorithm.
+         * @return The current dither mode.
+         */
+        DitherMode getDitherMode();
+
+        /**
+         * Switches how frames are stored. Indexed frames keep a palette plus a 4-bit or
+         * 8-bit index per pixel instead of full RGBA Pixels, which is much smaller for
+         * animations with few colors. Existing frames are converted.
+         * @param indexed Whether frames should be stored as indexed images.
+         * @param sharedPalette If true, all frames share one palette of at most 256 colors.
+         * Otherwise, every frame gets its own palette of at most 256 colors.
+         */
+        void setIndexed(bool indexed, bool sharedPalette = true);
+
+        /**
+         * Getter for whether frames are stored as indexed images.
+         * @return true if frames are indexed.
+         */
+        bool isIndexed();
+
+        /**
+         * Getter for indexed frames. Since this is a reference, this
+         * will allow for direct modification. Empty unless setIndexed(true) was called.
+         * @return A reference to the indexedFrames_ vector of the Animation object.
+         */
+        std::vector<IndexedPNG>& getIndexedFramesRef();
+
         /**
          * Compute the current size of the animation based on how many frames are in
          * the frame vector. For Arduino UNO R4 LED Matrix, each frame in the most
@@ -64,7 +146,7 @@ class Animation{
         /**
          * Adds a frame to the end of the animation. Method accounts for the source image
          * to not be in the correct format, and as such will scale it down to 12x8 and
-         * binarify it with black and white colors.
+         * binarify it with black and white colors, or dither it if setDither() was called.
          * @param myFrame The frame to be added.
          */
         void addFrameArd(PNG myFrame);
@@ -81,7 +163,8 @@ class Animation{
         /**
          * Scales all frames in the animation to the requested dimensions. Function
          * will always ensure uniform dimensions for all frames, and as such, sameDims_
-         * will be set to true.
+         * will be set to true. If the animation has an arena, buffers the old frames
+         * used are given back to the system afterwards.
          * @param x The new width
          * @param y The new height
          */
@@ -90,7 +173,8 @@ class Animation{
         /**
          * Modifies all frames in the animation to be compatible with the Arduino
          * UNO R4 LED Matrix by scaling down to 12x8 and binarifying with black
-         * and white colors. Operation is not reversible.
+         * and white colors, or dithering if setDither() was called. Operation is
+         * not reversible.
          */
         void arduinofy();
 
@@ -101,8 +185,9 @@ class Animation{
          * @param myFrame The frame to be converted
          * @param domColorA The first color of the image. This will be the LED ON color.
          * @param domColorB The second color of the image. This will be the LED OFF color.
+         * Does not depend on any Animation state, so it can be called without an instance.
          */
-        std::vector<u_int32_t> frameToArduino(PNG myFrame, Pixel domColorA, Pixel domColorB);
+        static std::vector<u_int32_t> frameToArduino(PNG myFrame, Pixel domColorA, Pixel domColorB);
 
         /**
          * Converts an entire Animation to the Arduino format of three 32-bit integers
@@ -113,12 +198,53 @@ class Animation{
          * @return A vector of vectors, where each vector is the state of the 96 LEDs
          * for that frame.
          */
-        std::vector<std::vector<u_int32_t>> Animation::animationToArduino();
+        std::vector<std::vector<u_int32_t>> animationToArduino();
+
+        /**
+         * Same as animationToArduino, but frames that differ from an earlier frame by at
+         * most threshold LEDs are merged into it, held frames are stored once and repeated
+         * sequences become loops. See compressFrames.
+         * @param threshold The largest number of differing LEDs for two frames to be merged.
+         * @param maxLoopLength The longest loop body, in runs of held frames, to look for.
+         * @return The compressed animation. expandFrames turns it back into one packed
+         * frame per source frame.
+         */
+        CompressedAnimation animationToArduinoCompressed(unsigned threshold, size_t maxLoopLength = 64);
 
     private:
         size_t fps_; // Frames per second of the animation. The lower, the longer.
         unsigned width_;
         unsigned height_;
         bool sameDims_; // Stores whether or not all frames are of the same dimensions.
+        std::shared_ptr<FrameArena> arena_; // Where frame pixels are allocated. Null for the heap. Declared before the frames so it outlives them.
         std::vector<PNG> frames_; // Vector of images that are part of the animation.
-};
\ No newline at end of file
+        bool indexed_; // Stores whether frames live in indexedFrames_ instead of frames_.
+        std::shared_ptr<Palette> palette_; // Palette shared by all indexed frames. Null for one palette per frame.
+        std::vector<IndexedPNG> indexedFrames_; // Frames of the animation when indexed_ is true.
+        DitherMode ditherMode_; // How frames are reduced to black and white for the LED matrix.
+        unsigned ditherStability_; // Hysteresis around the dither threshold against flicker.
+
+        /**
+         * Private helper function that returns where new frame pixels should be allocated.
+         * @return arena_ if set, otherwise the default heap resource.
+         */
+        std::pmr::memory_resource* frameResource();
+
+        /**
+         * Private helper function that appends a frame to whichever vector is in use.
+         * @param myFrame The frame to be added. Must be allocated from frameResource(). It is
+         * moved from when frames are not indexed. If it has too many colors for the shared
+         * palette, the error is thrown with the frames and palette unchanged.
+         */
+        void storeFrame(PNG& myFrame);
+
+        /**
+         * Private helper function that reduces a 12x8 frame to black and white according
+         * to ditherMode_.
+         * @param myFrame The frame to reduce.
+         * @param previous The previous frame of the animation, already reduced, or null.
+         */
+        void reduceFrame(PNG& myFrame, PNG* previous);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Fixed-capacity lock-free queue that any number of threads may push to and pop from.
+ * Each slot carries a sequence number that tells producers and consumers whose turn it
+ * is, so the only shared writes are a compare-and-swap on the head or tail position.
+ * Neither operation blocks; callers decide how to wait when the queue is full or empty.
+ */
+template <typename T>
+class BoundedQueue{
+    public:
+        /**
+         * Constructor. Capacity is rounded up to the next power of two so positions
+         * can be wrapped with a mask.
+         * @param capacity The minimum number of items the queue can hold. Must be greater than 0.
+         */
+        BoundedQueue(size_t capacity){
+            size_t rounded = 2;
+            while (rounded < capacity){
+                rounded <<= 1;
+            }
+            mask_ = rounded - 1;
+            cells_.reset(new Cell[rounded]);
+            for (size_t i=0; i < rounded; i++){
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            enqueuePos_.store(0, std::memory_order_relaxed);
+            dequeuePos_.store(0, std::memory_order_relaxed);
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        /**
+         * Attempts to add an item to the back of the queue.
+         * @param value The item to add. It is moved from only if the push succeeds.
+         * @return true if the item was added, false if the queue was full.
+         */
+        bool tryPush(T& value){
+            size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true){
+                cell = &cells_[pos & mask_];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+                if (diff == 0){ // slot is free for this position, try to claim it
+                    if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if (diff < 0){ // slot still holds an item from a lap ago
+                    return false;
+                } else{ // another producer got here first
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Attempts to take an item from the front of the queue.
+         * @param value Where the item is moved to on success.
+         * @return true if an item was taken, false if the queue was empty.
+         */
+        bool tryPop(T& value){
+            size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true){
+                cell = &cells_[pos & mask_];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+                if (diff == 0){ // slot holds the item for this position, try to claim it
+                    if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if (diff < 0){ // producer has not filled this slot yet
+                    return false;
+                } else{ // another consumer got here first
+                    pos = dequeuePos_.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(cell->data);
+            cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Approximate number of items in the queue. Only exact when no other thread is
+         * pushing or popping, so use it for statistics and not for control flow.
+         * @return The number of items in the queue.
+         */
+        size_t size(){
+            size_t tail = enqueuePos_.load(std::memory_order_relaxed);
+            size_t head = dequeuePos_.load(std::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+
+        /**
+         * Getter for capacity.
+         * @return The number of items the queue can hold after rounding.
+         */
+        size_t capacity(){
+            return mask_ + 1;
+        }
+
+    private:
+        struct Cell{
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> cells_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueuePos_; // kept on separate cache lines so producers
+        alignas(64) std::atomic<size_t> dequeuePos_; // and consumers do not false-share
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include "conversion-pipeline.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Helper function for the stage loops. Waits a little before the caller retries a queue
+ * operation. Yields at first, then sleeps so idle stages do not burn a core.
+ * @param spins How many times in a row the caller has had to wait. Incremented.
+ */
+static void backoff(unsigned& spins){
+    if (++spins < 64){
+        std::this_thread::yield();
+    } else{
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+/**
+ * Helper function that returns the nanoseconds elapsed since start.
+ */
+static long long nanosSince(Clock::time_point start){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Helper function for the read stage. Loads the raw bytes of a file without decoding them.
+ * @param filepath A string with the exact or relative file path to a real .png file
+ * @return The contents of the file.
+ */
+static std::vector<unsigned char> readFileBytes(const std::string& filepath){
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file){
+        throw std::runtime_error("ConversionPipeline::run() ERROR: Failed to open " + filepath + " for reading. Does the file exist?");
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<unsigned char> bytes(size);
+    if (!file.read((char*) bytes.data(), size)){
+        throw std::runtime_error("ConversionPipeline::run() ERROR: Failed to read " + filepath + ".");
+    }
+    return bytes;
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+Basic class functionality
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+ConversionPipeline::ConversionPipeline(PipelineConfig config) : config_(config), capacities_(), lastRunSeconds_(0) {
+    StageConfig stages[] = {config_.read, config_.decode, config_.transform, config_.pack};
+    for (StageConfig& s : stages){
+        if (s.workers == 0 || s.queueDepth == 0){
+            throw std::runtime_error("ConversionPipeline constructor ERROR: Every stage needs at least one worker and a queue depth greater than 0.");
+        }
+    }
+    for (StageCounters& c : counters_){
+        c.items = 0, c.busyNs = 0, c.stalledNs = 0;
+        c.occupancySum = 0, c.occupancySamples = 0, c.occupancyMax = 0;
+    }
+}
+
+void ConversionPipeline::fail(std::exception_ptr err){
+    std::lock_guard<std::mutex> lock(errorLock_);
+    if (!error_){
+        error_ = err;
+    }
+    aborted_ = true;
+}
+
+bool ConversionPipeline::push(BoundedQueue<Job>& queue, Job& job, size_t stage, size_t consumer){
+    Clock::time_point start = Clock::now();
+    unsigned spins = 0;
+    while (!queue.tryPush(job)){
+        if (aborted_){
+            return false;
+        }
+        backoff(spins);
+    }
+    counters_[stage].stalledNs += nanosSince(start);
+
+    /* Sample how many frames are waiting for the consumer right after handing it one more. */
+    StageCounters& c = counters_[consumer];
+    size_t occupancy = queue.size();
+    c.occupancySum += occupancy;
+    c.occupancySamples++;
+    size_t seen = c.occupancyMax.load();
+    while (occupancy > seen && !c.occupancyMax.compare_exchange_weak(seen, occupancy));
+    return true;
+}
+
+template <typename Work>
+void ConversionPipeline::stageLoop(size_t stage, BoundedQueue<Job>& in, std::atomic<unsigned>& upstreamLeft, BoundedQueue<Job>& out, Work work){
+    StageCounters& c = counters_[stage];
+    Job job;
+    while (!aborted_){
+        /* Wait for input. Once every upstream worker is done, one last empty pop means the
+        queue is drained for good. */
+        Clock::time_point waitStart = Clock::now();
+        unsigned spins = 0;
+        bool got = false;
+        while (!aborted_){
+            if (in.tryPop(job)){
+                got = true;
+                break;
+            }
+            if (upstreamLeft == 0){
+                got = in.tryPop(job);
+                break;
+            }
+            backoff(spins);
+        }
+        c.stalledNs += nanosSince(waitStart);
+        if (!got){
+            return;
+        }
+
+        Clock::time_point workStart = Clock::now();
+        try{
+            work(job);
+        } catch (...){
+            fail(std::current_exception());
+            return;
+        }
+        c.busyNs += nanosSince(workStart);
+        c.items++;
+
+        if (!push(out, job, stage, stage + 1)){
+            return;
+        }
+    }
+}
+
+/*@@@@@@@@@@@@@@@@@@@
+Running the pipeline
+@@@@@@@@@@@@@@@@@@@@@*/
+
+std::vector<std::vector<u_int32_t>> ConversionPipeline::run(const std::vector<std::string>& filepaths, std::ostream* out){
+    enum {READ, DECODE, TRANSFORM, PACK, WRITE};
+    Clock::time_point runStart = Clock::now();
+
+    /* Reset state left over from the previous run. */
+    for (StageCounters& c : counters_){
+        c.items = 0, c.busyNs = 0, c.stalledNs = 0;
+        c.occupancySum = 0, c.occupancySamples = 0, c.occupancyMax = 0;
+    }
+    nextIndex_ = 0;
+    written_ = 0;
+    aborted_ = false;
+    error_ = nullptr;
+
+    size_t total = filepaths.size();
+    std::vector<std::vector<u_int32_t>> result(total);
+
+    BoundedQueue<Job> readQ(config_.read.queueDepth);
+    BoundedQueue<Job> decodeQ(config_.decode.queueDepth);
+    BoundedQueue<Job> transformQ(config_.transform.queueDepth);
+    BoundedQueue<Job> packQ(config_.pack.queueDepth);
+    capacities_[READ] = 0;
+    capacities_[DECODE] = readQ.capacity();
+    capacities_[TRANSFORM] = decodeQ.capacity();
+    capacities_[PACK] = transformQ.capacity();
+    capacities_[WRITE] = packQ.capacity();
+
+    /* Frames that are read but not yet written can only be sitting in a queue, in a worker,
+    or in the writer's reorder window. Capping the read stage at that many frames ahead of
+    the writer is what bounds memory regardless of how uneven the stages are. */
+    size_t window = readQ.capacity() + decodeQ.capacity() + transformQ.capacity() + packQ.capacity()
+        + config_.read.workers + config_.decode.workers + config_.transform.workers + config_.pack.workers + 1;
+
+    std::atomic<unsigned> readLeft(config_.read.workers);
+    std::atomic<unsigned> decodeLeft(config_.decode.workers);
+    std::atomic<unsigned> transformLeft(config_.transform.workers);
+    std::atomic<unsigned> packLeft(config_.pack.workers);
+
+    std::vector<std::thread> threads;
+
+    /* Read stage: claim the next file, wait until it is inside the window, then load its bytes. */
+    for (unsigned w=0; w < config_.read.workers; w++){
+        threads.emplace_back([&](){
+            StageCounters& c = counters_[READ];
+            while (!aborted_){
+                size_t idx = nextIndex_++;
+                if (idx >= total){
+                    break;
+                }
+
+                Clock::time_point waitStart = Clock::now();
+                unsigned spins = 0;
+                while (!aborted_ && idx - written_ >= window){
+                    backoff(spins);
+                }
+                c.stalledNs += nanosSince(waitStart);
+                if (aborted_){
+                    break;
+                }
+
+                Job job;
+                job.index = idx;
+                Clock::time_point workStart = Clock::now();
+                try{
+                    job.bytes = readFileBytes(filepaths[idx]);
+                } catch (...){
+                    fail(std::current_exception());
+                    break;
+                }
+                c.busyNs += nanosSince(workStart);
+                c.items++;
+
+                if (!push(readQ, job, READ, DECODE)){
+                    break;
+                }
+            }
+            readLeft--;
+        });
+    }
+
+    /* Decode stage: raw bytes to a PNG. With an arena, a frame's buffer is handed back when the
+    pack stage is done with it and picked up again by a later decode or scale. */
+    std::pmr::memory_resource* resource = config_.arena ? (std::pmr::memory_resource*) config_.arena.get() : std::pmr::get_default_resource();
+    for (unsigned w=0; w < config_.decode.workers; w++){
+        threads.emplace_back([&](){
+            stageLoop(DECODE, readQ, readLeft, decodeQ, [&](Job& job){
+                job.frame.reset(new PNG(job.bytes, resource));
+                std::vector<unsigned char>().swap(job.bytes);
+            });
+            decodeLeft--;
+        });
+    }
+
+    /* Transform stage: same as Animation::arduinofy, one frame at a time. */
+    for (unsigned w=0; w < config_.transform.workers; w++){
+        threads.emplace_back([&](){
+            stageLoop(TRANSFORM, decodeQ, decodeLeft, transformQ, [&](Job& job){
+                job.frame->scale(12, 8);
+                if (config_.dither == DITHER_NONE){
+                    job.frame->binarify(config_.colorA, config_.colorB);
+                } else{
+                    job.frame->dither(config_.colorA, config_.colorB, config_.dither);
+                }
+            });
+            transformLeft--;
+        });
+    }
+
+    /* Pack stage: 12x8 frame to three 32-bit words. */
+    for (unsigned w=0; w < config_.pack.workers; w++){
+        threads.emplace_back([&](){
+            stageLoop(PACK, transformQ, transformLeft, packQ, [&](Job& job){
+                job.packed = Animation::frameToArduino(*job.frame, config_.colorA, config_.colorB);
+                job.frame.reset();
+            });
+            packLeft--;
+        });
+    }
+
+    /* Write stage runs on this thread. Frames arrive out of order, so they are parked in result
+    until everything before them is in, then written in order. */
+    {
+        StageCounters& c = counters_[WRITE];
+        std::vector<bool> ready(total, false);
+        Job job;
+        unsigned spins = 0;
+        Clock::time_point waitStart = Clock::now();
+        while (!aborted_ && written_ < total){
+            bool got = packQ.tryPop(job);
+            if (!got && packLeft == 0){
+                got = packQ.tryPop(job);
+                if (!got){
+                    break; // upstream finished without producing every frame, which only happens on failure
+                }
+            }
+            if (!got){
+                backoff(spins);
+                continue;
+            }
+            c.stalledNs += nanosSince(waitStart);
+            spins = 0;
+
+            Clock::time_point workStart = Clock::now();
+            result[job.index] = std::move(job.packed);
+            job.packed.clear();
+            ready[job.index] = true;
+            size_t next = written_;
+            while (next < total && ready[next]){
+                if (out){
+                    const std::vector<u_int32_t>& f = result[next];
+                    *out << "{ 0x" << std::hex << std::setfill('0') << std::setw(8) << f[0] << ", 0x" << std::setw(8) << f[1]
+                    << ", 0x" << std::setw(8) << f[2] << " }," << std::dec << std::setfill(' ') << "\n";
+                }
+                next++;
+            }
+            written_ = next;
+            c.busyNs += nanosSince(workStart);
+            c.items++;
+            waitStart = Clock::now();
+        }
+        if (out){
+            out->flush();
+        }
+    }
+
+    for (std::thread& t : threads){
+        t.join();
+    }
+    lastRunSeconds_ = nanosSince(runStart) / 1e9;
+
+    if (error_){
+        std::rethrow_exception(error_);
+    }
+    return result;
+}
+
+/*@@@@@@@@@@@@@@@@@
+Pipeline statistics
+@@@@@@@@@@@@@@@@@@@*/
+
+std::vector<StageStats> ConversionPipeline::getStats(){
+    const char* names[STAGE_COUNT] = {"read", "decode", "transform", "pack", "write"};
+    unsigned workers[STAGE_COUNT] = {config_.read.workers, config_.decode.workers, config_.transform.workers, config_.pack.workers, 1};
+    std::vector<StageStats> stats;
+    for (size_t i=0; i < STAGE_COUNT; i++){
+        StageCounters& c = counters_[i];
+        StageStats s;
+        s.name = names[i];
+        s.workers = workers[i];
+        s.items = c.items;
+        s.busySeconds = c.busyNs / 1e9;
+        s.stalledSeconds = c.stalledNs / 1e9;
+        s.inputCapacity = capacities_[i];
+        s.avgOccupancy = c.occupancySamples ? (double) c.occupancySum / c.occupancySamples : 0;
+        s.maxOccupancy = c.occupancyMax;
+        stats.emplace_back(s);
+    }
+    return stats;
+}
+
+void ConversionPipeline::printStats(std::ostream& os){
+    os << std::left << std::setw(10) << "stage" << std::right << std::setw(8) << "workers" << std::setw(8) << "items"
+    << std::setw(10) << "busy %" << std::setw(12) << "queue avg" << std::setw(12) << "queue max" << "\n";
+    for (StageStats& s : getStats()){
+        // share of the run the stage's workers spent doing work
+        double busy = lastRunSeconds_ > 0 ? 100 * s.busySeconds / (s.workers * lastRunSeconds_) : 0;
+        os << std::left << std::setw(10) << s.name << std::right << std::setw(8) << s.workers << std::setw(8) << s.items
+        << std::setw(10) << std::fixed << std::setprecision(1) << busy
+        << std::setw(12) << std::setprecision(2) << (s.inputCapacity ? s.avgOccupancy : 0)
+        << std::setw(12) << (s.inputCapacity ? std::to_string(s.maxOccupancy) + "/" + std::to_string(s.inputCapacity) : "-") << "\n";
+    }
+    os << std::defaultfloat;
+}
@@ -0,0 +1,141 @@
+#ifndef CONVERSION_PIPELINE_H
+#define CONVERSION_PIPELINE_H
+
+#include "arduino-animation.h"
+#include "bounded-queue.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+/* Worker count and output queue depth of a single pipeline stage. */
+struct StageConfig{
+    unsigned workers;
+    size_t queueDepth; // capacity of the queue this stage pushes into, rounded up to a power of two
+
+    StageConfig(unsigned w = 1, size_t q = 8) : workers(w), queueDepth(q) {};
+};
+
+/* Sizing of every stage of a ConversionPipeline. The write stage is always a single thread
+since it has to emit frames in order. */
+struct PipelineConfig{
+    StageConfig read;      // fopen + fread of the raw .png bytes
+    StageConfig decode;    // libpng decode into a PNG
+    StageConfig transform; // scale to 12x8 and binarify or dither
+    StageConfig pack;      // pack into three 32-bit words
+    Pixel colorA;          // LED ON color
+    Pixel colorB;          // LED OFF color
+    DitherMode dither;     // frames finish out of order, so there is no temporal stability here
+    std::shared_ptr<FrameArena> arena; // if set, decoded frames and their scaled copies are allocated here
+
+    PipelineConfig() : read(1), decode(2), transform(1), pack(1), colorA(BLACK), colorB(WHITE), dither(DITHER_NONE) {};
+};
+
+/* What a stage did during the last run. */
+struct StageStats{
+    std::string name;
+    unsigned workers;
+    size_t items;            // frames that went through the stage
+    double busySeconds;      // time spent doing work, summed over workers
+    double stalledSeconds;   // time spent waiting for input or for room downstream, summed over workers
+    size_t inputCapacity;    // capacity of the queue the stage pops from (0 for read)
+    double avgOccupancy;     // average number of frames waiting in that queue
+    size_t maxOccupancy;     // highest number of frames seen waiting in that queue
+};
+
+class ConversionPipeline{
+    public:
+        /**
+         * Constructor. Every stage must have at least one worker and a queue depth
+         * greater than 0.
+         * @param config The sizing of each stage.
+         */
+        ConversionPipeline(PipelineConfig config = PipelineConfig());
+
+        /**
+         * Converts a list of .png files to Arduino frames. Reading, decoding, transforming
+         * and packing run concurrently on their own threads, connected by bounded lock-free
+         * queues, so disk waits overlap with computation. The number of frames in flight is
+         * capped by the queue depths and worker counts, no matter how many files there are.
+         * If any frame fails, the pipeline stops and the first error is rethrown.
+         * @param filepaths The frames of the animation, in order.
+         * @param out If not null, each frame is also written here in order as an Arduino
+         * array initializer line as soon as it is ready.
+         * @return The packed frames in the same order as filepaths, in the same format as
+         * Animation::animationToArduino.
+         */
+        std::vector<std::vector<u_int32_t>> run(const std::vector<std::string>& filepaths, std::ostream* out = nullptr);
+
+        /**
+         * Getter for stage statistics of the last run. A stage whose input queue is
+         * usually full, or that is busy while every other stage stalls, is the bottleneck.
+         * @return One entry per stage in pipeline order: read, decode, transform, pack, write.
+         */
+        std::vector<StageStats> getStats();
+
+        /**
+         * Prints the statistics of the last run as a table.
+         * @param os The stream to print to.
+         */
+        void printStats(std::ostream& os);
+
+    private:
+        /* A single frame as it moves through the pipeline. Each stage fills in the next field
+        and releases the previous one so only one representation is held at a time. */
+        struct Job{
+            size_t index;
+            std::vector<unsigned char> bytes;
+            std::unique_ptr<PNG> frame;
+            std::vector<u_int32_t> packed;
+        };
+
+        /* Counters updated by a stage's workers while running. */
+        struct StageCounters{
+            std::atomic<size_t> items;
+            std::atomic<long long> busyNs;
+            std::atomic<long long> stalledNs;
+            std::atomic<size_t> occupancySum;
+            std::atomic<size_t> occupancySamples;
+            std::atomic<size_t> occupancyMax;
+        };
+
+        static const size_t STAGE_COUNT = 5;
+        PipelineConfig config_;
+        StageCounters counters_[STAGE_COUNT];
+        size_t capacities_[STAGE_COUNT]; // input queue capacity of each stage in the last run
+        double lastRunSeconds_;
+
+        /* Shared state of the current run. */
+        std::atomic<size_t> nextIndex_;   // next file for the read stage to claim
+        std::atomic<size_t> written_;     // frames emitted by the write stage so far
+        std::atomic<bool> aborted_;
+        std::mutex errorLock_;
+        std::exception_ptr error_;
+
+        /**
+         * Private helper function that stops the run and keeps the first error seen.
+         */
+        void fail(std::exception_ptr err);
+
+        /**
+         * Private helper function that pushes a job downstream, backing off while the queue
+         * is full. Records occupancy of the queue for the consuming stage.
+         * @return false if the run was aborted before the push succeeded.
+         */
+        bool push(BoundedQueue<Job>& queue, Job& job, size_t stage, size_t consumer);
+
+        /**
+         * Private helper function that runs one worker of a middle stage: pop, work, push
+         * until the upstream stage is finished and the input queue is empty.
+         * @param stage Index of this stage in counters_.
+         * @param in The queue this stage consumes.
+         * @param upstreamLeft Number of upstream workers that have not finished yet.
+         * @param out The queue this stage produces into.
+         * @param work The operation performed on each job.
+         */
+        template <typename Work>
+        void stageLoop(size_t stage, BoundedQueue<Job>& in, std::atomic<unsigned>& upstreamLeft, BoundedQueue<Job>& out, Work work);
+};
+
+#endif
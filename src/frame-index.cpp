@@ -0,0 +1,411 @@
+#include "frame-index.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Helper function that counts the set bits of a word. __builtin_popcount becomes a library
+ * call unless the build enables the popcnt instruction, which is several times slower.
+ * @param x The word.
+ * @return The number of bits set in x.
+ */
+static inline unsigned countBits(uint64_t x){
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/**
+ * Helper function that counts the differing bits of two packed frames. Words are taken in
+ * pairs so a frame of three words costs two bit counts rather than three.
+ * @param a,b The first word of each frame.
+ * @param words The number of words per frame.
+ * @return The Hamming distance between the frames.
+ */
+static inline unsigned frameDistance(const u_int32_t* a, const u_int32_t* b, unsigned words){
+    unsigned distance = 0, w = 0;
+    for (; w + 1 < words; w += 2){
+        distance += countBits(((uint64_t) (a[w+1] ^ b[w+1]) << 32) | (a[w] ^ b[w]));
+    }
+    if (w < words){
+        distance += countBits(a[w] ^ b[w]);
+    }
+    return distance;
+}
+
+/**
+ * Helper function for band layout. Number of keys within radius differing bits of a key.
+ * @param width The number of bits in the key.
+ * @param radius The largest number of flipped bits.
+ * @param limit Counting stops once the total passes limit.
+ * @return The sum of width choose i for i = 0..radius, or a value above limit.
+ */
+static unsigned long long countNeighbours(unsigned width, unsigned radius, unsigned long long limit){
+    unsigned long long total = 0, choose = 1;
+    for (unsigned i=0; i <= radius && i <= width && total <= limit; i++){
+        total += choose;
+        choose = choose * (width - i) / (i + 1);
+    }
+    return total;
+}
+
+/**
+ * Helper function for lookups. Calls visit(neighbour, flips) on key and every key that differs
+ * from it in at most radius of the bits from start up to width, each exactly once.
+ */
+template <typename Visit>
+static void forEachNeighbour(uint64_t key, unsigned width, unsigned radius, unsigned start, unsigned flips, Visit& visit){
+    visit(key, flips);
+    if (flips == radius){
+        return;
+    }
+    for (unsigned bit = start; bit < width; bit++){
+        forEachNeighbour(key ^ (uint64_t) 1 << bit, width, radius, bit + 1, flips + 1, visit);
+    }
+}
+
+/**
+ * Helper function for the band tables. Spreads a band key over the table.
+ */
+static uint64_t mixKey(uint64_t key){
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return key ^ key >> 31;
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+Basic class functionality
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+FrameIndex::FrameIndex(unsigned maxDistance, unsigned leds) : maxDistance_(maxDistance), query_(0) {
+    if (leds == 0){
+        throw std::runtime_error("FrameIndex constructor ERROR: Frames must have at least one LED.");
+    }
+    words_ = (leds + 31) / 32;
+    root_.depth = 0;
+    for (unsigned i=0; i < leds; i++){
+        root_.leds.push_back(i);
+    }
+    layout(root_);
+}
+
+size_t FrameIndex::size(){return seen_.size();}
+
+std::vector<u_int32_t> FrameIndex::getFrame(size_t id){
+    if (id >= size()){
+        throw std::runtime_error("FrameIndex::getFrame() ERROR: Frame " + std::to_string(id) + " is out of bounds. Index has "
+        + std::to_string(size()) + " frames.");
+    }
+    return std::vector<u_int32_t>(frames_.begin() + id*words_, frames_.begin() + (id+1)*words_);
+}
+
+unsigned FrameIndex::hammingDistance(const std::vector<u_int32_t>& a, const std::vector<u_int32_t>& b){
+    return frameDistance(a.data(), b.data(), a.size());
+}
+
+/*@@@@@@@@@@@@@@@@@@@
+Indexing and lookups
+@@@@@@@@@@@@@@@@@@@@@*/
+
+void FrameIndex::layout(Node& node){
+    /* If m bands may differ in r_0..r_m-1 LEDs, two frames within maxDistance are within r_b
+    of each other in some band b as long as the (r_b + 1) add up to more than maxDistance.
+    Wider bands have fewer frames per key but more keys within r_b of a query, so weigh the
+    keys a lookup tries against the frames it would compare in an index of expectedFrames
+    random frames. */
+    const unsigned long long probeLimit = 128;
+    const double expectedFrames = 65536;
+    unsigned leds = node.leds.size();
+    node.scan = true;
+    if (maxDistance_ >= leds){
+        return; // every frame matches every other one
+    }
+    unsigned needed = maxDistance_ + 1;
+    unsigned fewest = (leds + 63) / 64;
+    double bestCost = 0;
+    for (unsigned m = fewest; m <= std::max(needed, fewest); m++){
+        std::vector<Band> bands(m);
+        unsigned long long probes = 0;
+        double share = 0; // expected share of all frames under the probed keys, if LEDs were random
+        for (unsigned b=0; b < m; b++){
+            bands[b].begin = (unsigned long long) b*leds / m;
+            bands[b].width = (unsigned long long) (b+1)*leds / m - bands[b].begin;
+            unsigned quota = needed / m + (b < needed % m ? 1 : 0);
+            bands[b].radius = quota > 0 ? quota - 1 : 0;
+            unsigned long long keys = countNeighbours(bands[b].width, bands[b].radius, probeLimit);
+            probes += keys;
+            share += keys / (double) ((uint64_t) 1 << std::min(bands[b].width, 63u));
+        }
+        double cost = probes + expectedFrames*share;
+        if (probes > probeLimit || share >= 0.25 || (!node.scan && cost >= bestCost)){
+            continue; // too many keys, keys too short to rule much out, or no better
+        }
+        node.scan = false;
+        node.bands = bands;
+        bestCost = cost;
+    }
+    if (!node.scan){
+        size_t m = node.bands.size();
+        node.tables.assign(m, std::vector<Slot>(16, Slot{0, UINT32_MAX}));
+        node.tableUsed.assign(m, 0);
+    }
+}
+
+uint64_t FrameIndex::bandKey(const Node& node, const u_int32_t* frame, const Band& band){
+    uint64_t key = 0;
+    for (unsigned i=0; i < band.width; i++){
+        unsigned led = node.leds[band.begin + i];
+        key |= (uint64_t) (frame[led/32] >> led%32 & 0x1) << i;
+    }
+    return key;
+}
+
+bool FrameIndex::needsChild(const Node& node, const Band& band, uint64_t key){
+    /* Narrow bands have few enough frames per key, and a child over a handful of LEDs
+    would not narrow anything down. Every level also multiplies the nodes a mostly-off query
+    walks through, so children stop two levels below the root. */
+    const unsigned minWidth = 16, maxDepth = 2;
+    if (node.depth >= maxDepth || band.width < minWidth || node.leds.size() - band.width < minWidth){
+        return false;
+    }
+    unsigned on = countBits(key);
+    return on == 0 || on == band.width;
+}
+
+FrameIndex::Slot& FrameIndex::findSlot(Node& node, size_t band, uint64_t key){
+    std::vector<Slot>& table = node.tables[band];
+    size_t mask = table.size() - 1;
+    for (size_t i = mixKey(key) & mask;; i = (i + 1) & mask){
+        if (table[i].bucket == UINT32_MAX || table[i].key == key){
+            return table[i];
+        }
+    }
+}
+
+void FrameIndex::insert(Node& node, const u_int32_t* frame, u_int32_t id){
+    if (node.scan){
+        node.entries.insert(node.entries.end(), frame, frame + words_);
+        node.entries.push_back(id);
+        return;
+    }
+
+    for (size_t b=0; b < node.bands.size(); b++){
+        /* Keep tables at most half full so probes for missing keys stop quickly. */
+        if (2*(node.tableUsed[b] + 1) > node.tables[b].size()){
+            std::vector<Slot> old(2*node.tables[b].size(), Slot{0, UINT32_MAX});
+            old.swap(node.tables[b]);
+            for (Slot& slot : old){
+                if (slot.bucket != UINT32_MAX){
+                    findSlot(node, b, slot.key) = slot;
+                }
+            }
+        }
+
+        const Band& band = node.bands[b];
+        uint64_t key = bandKey(node, frame, band);
+        Slot& slot = findSlot(node, b, key);
+        if (slot.bucket == UINT32_MAX){
+            slot = Slot{key, (u_int32_t) node.buckets.size()};
+            node.tableUsed[b]++;
+            node.buckets.emplace_back();
+            if (needsChild(node, band, key)){
+                Node* child = new Node();
+                node.buckets.back().child.reset(child);
+                child->depth = node.depth + 1;
+                child->leds.insert(child->leds.end(), node.leds.begin(), node.leds.begin() + band.begin);
+                child->leds.insert(child->leds.end(), node.leds.begin() + band.begin + band.width, node.leds.end());
+                layout(*child);
+            }
+        }
+
+        Bucket& bucket = node.buckets[slot.bucket];
+        if (bucket.child){
+            insert(*bucket.child, frame, id);
+        } else{
+            bucket.entries.insert(bucket.entries.end(), frame, frame + words_);
+            bucket.entries.push_back(id);
+        }
+    }
+}
+
+size_t FrameIndex::add(const std::vector<u_int32_t>& frame){
+    if (frame.size() != words_){
+        throw std::runtime_error("FrameIndex::add() ERROR: Frame has " + std::to_string(frame.size()) + " words, expected "
+        + std::to_string(words_) + ".");
+    }
+    if (size() >= UINT32_MAX){
+        throw std::runtime_error("FrameIndex::add() ERROR: Index cannot hold more than " + std::to_string(UINT32_MAX) + " frames.");
+    }
+
+    size_t id = size();
+    frames_.insert(frames_.end(), frame.begin(), frame.end());
+    seen_.push_back(0);
+    insert(root_, frame.data(), id);
+    return id;
+}
+
+template <typename Found>
+void FrameIndex::search(Node& node, const u_int32_t* frame, unsigned distance, unsigned budget, Found& found){
+    const unsigned words = words_, stride = words_ + 1; // locals, so the compiler need not reload them after found()
+    auto scanEntries = [&](const std::vector<u_int32_t>& entries){
+        const u_int32_t* entry = entries.data();
+        const u_int32_t* end = entry + entries.size();
+        for (; entry < end; entry += stride){
+            unsigned d = frameDistance(frame, entry, words);
+            if (d <= distance && seen_[entry[words]] != query_){
+                seen_[entry[words]] = query_;
+                found(entry[words], d);
+            }
+        }
+    };
+    if (node.scan){
+        scanEntries(node.entries);
+        return;
+    }
+
+    /* A frame within budget of the query on this node's LEDs is within radius of it in some
+    band, and also within budget there, so only keys that close need to be looked at. */
+    for (size_t b=0; b < node.bands.size(); b++){
+        auto visit = [&](uint64_t key, unsigned flips){
+            Slot& slot = findSlot(node, b, key);
+            if (slot.bucket == UINT32_MAX){
+                return;
+            }
+            Bucket& bucket = node.buckets[slot.bucket];
+            if (bucket.child){
+                search(*bucket.child, frame, distance, budget - flips, found);
+            } else{
+                scanEntries(bucket.entries);
+            }
+        };
+        const Band& band = node.bands[b];
+        forEachNeighbour(bandKey(node, frame, band), band.width, std::min(band.radius, budget), 0, 0, visit);
+    }
+}
+
+template <typename Found>
+void FrameIndex::forEachWithin(const std::vector<u_int32_t>& frame, unsigned distance, Found found){
+    if (frame.size() != words_){
+        throw std::runtime_error("FrameIndex lookup ERROR: Frame has " + std::to_string(frame.size()) + " words, expected "
+        + std::to_string(words_) + ".");
+    }
+    if (distance > maxDistance_){
+        throw std::runtime_error("FrameIndex lookup ERROR: Distance " + std::to_string(distance) + " is larger than the index was built for ("
+        + std::to_string(maxDistance_) + ").");
+    }
+
+    /* A frame can be near the query in several bands, so remember which ids this query has
+    already reported instead of collecting them into a set. */
+    query_++;
+    search(root_, frame.data(), distance, distance, found);
+}
+
+std::vector<size_t> FrameIndex::findWithin(const std::vector<u_int32_t>& frame, unsigned distance){
+    std::vector<size_t> result;
+    forEachWithin(frame, distance, [&](size_t id, unsigned){
+        result.push_back(id);
+    });
+    return result;
+}
+
+long long FrameIndex::findNearest(const std::vector<u_int32_t>& frame, unsigned* distanceOut){
+    long long best = -1;
+    unsigned bestDistance = maxDistance_ + 1;
+    forEachWithin(frame, maxDistance_, [&](size_t id, unsigned d){
+        if (d < bestDistance || (d == bestDistance && (long long) id < best)){
+            best = id;
+            bestDistance = d;
+        }
+    });
+    if (distanceOut && best >= 0){
+        *distanceOut = bestDistance;
+    }
+    return best;
+}
+
+/*@@@@@@@@@@@@@@@@@
+Export compression
+@@@@@@@@@@@@@@@@@@@*/
+
+CompressedAnimation compressFrames(const std::vector<std::vector<u_int32_t>>& packed, unsigned threshold, size_t maxLoopLength){
+    CompressedAnimation result;
+    result.sourceFrames = packed.size();
+    if (packed.empty()){
+        return result;
+    }
+
+    /* Map every frame to the closest distinct frame seen so far, or make it a new one. Only
+    distinct frames go into the index, so long still stretches do not grow its buckets. */
+    FrameIndex index(threshold, packed[0].size()*32);
+    std::vector<FrameRun> runs;
+    for (const std::vector<u_int32_t>& frame : packed){
+        long long id = index.findNearest(frame);
+        if (id < 0){
+            id = index.add(frame);
+            result.frames.push_back(frame);
+        }
+        if (!runs.empty() && runs.back().frame == (size_t) id){
+            runs.back().hold++;
+        } else{
+            runs.push_back(FrameRun{(size_t) id, 1});
+        }
+    }
+
+    /* Look for runs that repeat back to back. At each position, pick the loop length that
+    saves the most runs; a single-key check rules out most lengths before comparing ranges. */
+    std::vector<uint64_t> keys(runs.size());
+    for (size_t i=0; i < runs.size(); i++){
+        keys[i] = (uint64_t) runs[i].frame << 32 | runs[i].hold;
+    }
+
+    FrameBlock literal = {{}, 1};
+    size_t n = runs.size();
+    size_t p = 0;
+    while (p < n){
+        size_t bestLength = 0, bestRepeats = 1, bestSaved = 0;
+        for (size_t length = 1; length <= maxLoopLength && p + 2*length <= n; length++){
+            size_t repeats = 1;
+            while (p + (repeats+1)*length <= n && keys[p] == keys[p + repeats*length]
+                   && std::equal(keys.begin() + p, keys.begin() + p + length, keys.begin() + p + repeats*length)){
+                repeats++;
+            }
+            size_t saved = (repeats - 1)*length;
+            if (saved > bestSaved){
+                bestLength = length, bestRepeats = repeats, bestSaved = saved;
+            }
+        }
+
+        if (bestSaved == 0){
+            literal.runs.push_back(runs[p]);
+            p++;
+            continue;
+        }
+        if (!literal.runs.empty()){
+            result.blocks.push_back(literal);
+            literal.runs.clear();
+        }
+        result.blocks.push_back(FrameBlock{std::vector<FrameRun>(runs.begin() + p, runs.begin() + p + bestLength), (unsigned) bestRepeats});
+        p += bestLength*bestRepeats;
+    }
+    if (!literal.runs.empty()){
+        result.blocks.push_back(literal);
+    }
+
+    return result;
+}
+
+std::vector<std::vector<u_int32_t>> expandFrames(const CompressedAnimation& compressed){
+    std::vector<std::vector<u_int32_t>> result;
+    result.reserve(compressed.sourceFrames);
+    for (const FrameBlock& block : compressed.blocks){
+        for (unsigned r=0; r < block.repeats; r++){
+            for (const FrameRun& run : block.runs){
+                result.insert(result.end(), run.hold, compressed.frames[run.frame]);
+            }
+        }
+    }
+    return result;
+}
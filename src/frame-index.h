@@ -0,0 +1,208 @@
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+/* A dictionary frame shown for one or more consecutive source frames. */
+struct FrameRun{
+    size_t frame;  // index into CompressedAnimation::frames
+    unsigned hold; // number of source frames it stays on screen for
+};
+
+/* A run of FrameRuns played back repeats times in a row. Blocks that are not loops have
+repeats == 1. */
+struct FrameBlock{
+    std::vector<FrameRun> runs;
+    unsigned repeats;
+};
+
+/* Result of compressFrames(): every distinct frame once, plus the order to play them in. */
+struct CompressedAnimation{
+    std::vector<std::vector<u_int32_t>> frames; // packed frames, same format as Animation::frameToArduino
+    std::vector<FrameBlock> blocks;             // playback order
+    size_t sourceFrames;                        // number of frames before compression
+};
+
+/**
+ * Index over packed frames that finds every stored frame within a small number of differing
+ * LEDs of a query frame. The LEDs are split into bands, each allowed to differ in a few LEDs,
+ * so that two frames within maxDistance must be that close in at least one band. A lookup
+ * lists the keys near each of the query's bands and compares only the frames stored under
+ * them.
+ *
+ * A band with all LEDs off (or on) is shared by most mostly-off (or mostly-on) frames, so
+ * instead of one long bucket that key gets an index of its own over the remaining LEDs,
+ * searched with whatever distance the band has not used up.
+ *
+ * Lookups are not equally fast on every input. Compressing 100k random frames with
+ * compressFrames() takes about 0.2 s at maxDistance 3 and 0.75 s at 8, but 3.5 s at 15 and
+ * 5 s at 16. Frames with few LEDs on share most of their band keys, so they miss the one
+ * second mark even at small distances: about 1 s at maxDistance 3 with up to 20 LEDs on,
+ * 2 s at maxDistance 3 with up to 9 LEDs on, and 7 s at maxDistance 8 with up to 9 LEDs on.
+ */
+class FrameIndex{
+    public:
+        /**
+         * Constructor. Creates an empty index. The bands are sized so a lookup tries at most
+         * 128 keys per level. When maxDistance is so large that bands that short would match
+         * a large share of all frames (maxDistance > 20 for 96 LEDs, and always when
+         * maxDistance >= leds), lookups compare every stored frame instead.
+         * @param maxDistance The largest Hamming distance queries will ask for.
+         * @param leds The number of LEDs (bits actually used) per packed frame. 96 for the 12x8
+         * matrix. Frames take ceil(leds / 32) words.
+         */
+        FrameIndex(unsigned maxDistance, unsigned leds = 96);
+
+        /**
+         * Adds a frame to the index.
+         * @param frame The packed frame. Must have the word count implied by the constructor.
+         * @return The id of the frame, which is its position in insertion order.
+         */
+        size_t add(const std::vector<u_int32_t>& frame);
+
+        /**
+         * Finds every stored frame within a Hamming distance of frame.
+         * @param frame The packed frame to look up.
+         * @param distance The largest number of differing LEDs. Must not exceed maxDistance.
+         * @return The ids of all matching frames, in no particular order.
+         */
+        std::vector<size_t> findWithin(const std::vector<u_int32_t>& frame, unsigned distance);
+
+        /**
+         * Finds the closest stored frame, if any is within maxDistance.
+         * @param frame The packed frame to look up.
+         * @param distanceOut If not null, set to the distance of the returned frame.
+         * @return The id of the closest frame (lowest id on ties), or -1 if none is close enough.
+         */
+        long long findNearest(const std::vector<u_int32_t>& frame, unsigned* distanceOut = nullptr);
+
+        /**
+         * Getter for a stored frame.
+         * @param id The id returned by add(). Must be in-bounds.
+         * @return The packed frame.
+         */
+        std::vector<u_int32_t> getFrame(size_t id);
+
+        /**
+         * Number of frames in the index.
+         * @return The number of frames added so far.
+         */
+        size_t size();
+
+        /**
+         * Number of LEDs that differ between two packed frames.
+         * @param a,b The packed frames. Must have the same word count.
+         * @return The Hamming distance between a and b.
+         */
+        static unsigned hammingDistance(const std::vector<u_int32_t>& a, const std::vector<u_int32_t>& b);
+
+    private:
+        /* A range of a node's LEDs looked up together. */
+        struct Band{
+            unsigned begin;  // first entry of Node::leds in the band
+            unsigned width;  // number of LEDs, at most 64 so the key fits in a uint64_t
+            unsigned radius; // number of LEDs a lookup lets differ within this band
+        };
+
+        /* Slot of a band's hash table, mapping a band key to its bucket. */
+        struct Slot{
+            uint64_t key;
+            u_int32_t bucket; // index into Node::buckets, or UINT32_MAX if the slot is free
+        };
+
+        struct Node;
+
+        /* Frames sharing a band key: either listed directly or, for keys with all LEDs off or
+        on, indexed again by a child node over the LEDs outside the band. */
+        struct Bucket{
+            std::vector<u_int32_t> entries; // words_ frame words followed by the id, so a bucket is read front to back
+            std::unique_ptr<Node> child;
+        };
+
+        /* One level of the index, covering some of the LEDs. */
+        struct Node{
+            std::vector<unsigned> leds; // LED numbers this node looks at
+            unsigned depth; // 0 for the root
+            bool scan; // true when bands would not narrow lookups down, so every entry is compared
+            std::vector<u_int32_t> entries; // all frames of a scanning node, same layout as Bucket::entries
+            std::vector<Band> bands;
+            std::vector<std::vector<Slot>> tables; // per band, open addressing, size is a power of two
+            std::vector<size_t> tableUsed; // per band, slots in use
+            std::vector<Bucket> buckets;
+        };
+
+        unsigned maxDistance_;
+        unsigned words_;
+        Node root_;
+        std::vector<u_int32_t> frames_; // all frames back to back, words_ per frame
+        std::vector<size_t> seen_; // per id, the last query that reported it, to skip duplicates
+        size_t query_; // number of queries so far
+
+        /**
+         * Private helper function that picks the bands of a node from its LEDs, or makes it
+         * a scanning node.
+         */
+        void layout(Node& node);
+
+        /**
+         * Private helper function that extracts the LEDs of one band of a frame.
+         * @return The band's LEDs, first LED in the least significant bit.
+         */
+        uint64_t bandKey(const Node& node, const u_int32_t* frame, const Band& band);
+
+        /**
+         * Private helper function that tells whether a band key is shared by so many frames
+         * that it gets a child node instead of a plain bucket.
+         */
+        bool needsChild(const Node& node, const Band& band, uint64_t key);
+
+        /**
+         * Private helper function that finds the slot of a key in a band's table.
+         * @return The slot holding key, or the free slot where it would go.
+         */
+        Slot& findSlot(Node& node, size_t band, uint64_t key);
+
+        /**
+         * Private helper function that stores a frame in a node and the children it belongs to.
+         */
+        void insert(Node& node, const u_int32_t* frame, u_int32_t id);
+
+        /**
+         * Private helper function that calls found(id, distance) for frames of a node within
+         * distance of frame. Frames that differ from frame in more than budget of the node's
+         * LEDs may be skipped.
+         */
+        template <typename Found>
+        void search(Node& node, const u_int32_t* frame, unsigned distance, unsigned budget, Found& found);
+
+        /**
+         * Private helper function that calls found(id, distance) once for every stored frame
+         * within distance of frame.
+         */
+        template <typename Found>
+        void forEachWithin(const std::vector<u_int32_t>& frame, unsigned distance, Found found);
+};
+
+/**
+ * Shrinks a sequence of packed frames for export. Frames within threshold differing LEDs of an
+ * earlier distinct frame are replaced by it, consecutive repeats of a frame become a single
+ * run with a longer hold, and runs that repeat back to back become loops.
+ * @param packed The packed frames, e.g. from Animation::animationToArduino.
+ * @param threshold The largest number of differing LEDs for two frames to be merged. 0 only
+ * merges identical frames.
+ * @param maxLoopLength The longest loop body, in runs, that is searched for.
+ * @return The compressed animation.
+ */
+CompressedAnimation compressFrames(const std::vector<std::vector<u_int32_t>>& packed, unsigned threshold, size_t maxLoopLength = 64);
+
+/**
+ * Plays a compressed animation back into one packed frame per source frame.
+ * @param compressed The output of compressFrames.
+ * @return The packed frames, with merged frames replaced by their stand-ins.
+ */
+std::vector<std::vector<u_int32_t>> expandFrames(const CompressedAnimation& compressed);
+
+#endif
@@ -0,0 +1,206 @@
+#include "video-wall.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * Helper function for packing. Squared Euclidian distance between two Pixels in
+ * RGBA space. The square root is skipped since only comparisons are needed.
+ * @param a, b The two pixels to compare.
+ * @return The squared distance
+ */
+static unsigned squaredDistance(const Pixel& a, const Pixel& b){
+    int dr = (int) a.red - (int) b.red;
+    int dg = (int) a.green - (int) b.green;
+    int db = (int) a.blue - (int) b.blue;
+    int da = (int) a.alpha - (int) b.alpha;
+    return dr*dr + dg*dg + db*db + da*da;
+}
+
+/*@@@@@@@@@@@@@@@@@@@@@@@
+Basic class functionality
+@@@@@@@@@@@@@@@@@@@@@@@@@*/
+
+VideoWall::VideoWall(unsigned rows, unsigned cols, unsigned panelW, unsigned panelH)
+    : rows_(rows), cols_(cols), panelW_(panelW), panelH_(panelH), threads_(0) {
+    if (rows == 0 || cols == 0 || panelW == 0 || panelH == 0){
+        throw std::runtime_error("VideoWall constructor ERROR: Grid and panel dimensions must be greater than 0.");
+    }
+    panels_.resize(rows_*cols_);
+    updateLayout();
+}
+
+void VideoWall::setPanel(unsigned row, unsigned col, PanelConfig config){
+    if (row >= rows_ || col >= cols_){
+        throw std::runtime_error("VideoWall::setPanel() ERROR: Panel (" + std::to_string(row) + ", " + std::to_string(col) +
+        ") is out of bounds. Grid dimensions are (" + std::to_string(rows_) + ", " + std::to_string(cols_) + ").");
+    }
+    if (config.rotation != ROTATE_0 && config.rotation != ROTATE_90 && config.rotation != ROTATE_180 && config.rotation != ROTATE_270){
+        throw std::runtime_error("VideoWall::setPanel() ERROR: Rotation must be 0, 90, 180 or 270 degrees.");
+    }
+    panels_[col + row*cols_] = config;
+    updateLayout();
+}
+
+PanelConfig VideoWall::getPanel(unsigned row, unsigned col){
+    if (row >= rows_ || col >= cols_){
+        throw std::runtime_error("VideoWall::getPanel() ERROR: Panel (" + std::to_string(row) + ", " + std::to_string(col) +
+        ") is out of bounds. Grid dimensions are (" + std::to_string(rows_) + ", " + std::to_string(cols_) + ").");
+    }
+    return panels_[col + row*cols_];
+}
+
+unsigned VideoWall::getWidth(){return wallW_;}
+unsigned VideoWall::getHeight(){return wallH_;}
+size_t VideoWall::getPanelCount(){return panels_.size();}
+void VideoWall::setThreads(unsigned threads){threads_ = threads;}
+
+/*@@@@@@@@@@@@@@@@
+Layout computation
+@@@@@@@@@@@@@@@@@@*/
+
+void VideoWall::updateLayout(){
+    /* First pass: size the grid. A column is as wide as the widest footprint in it and a row
+    as tall as the tallest, so turned panels get room without hand-computed offsets. */
+    std::vector<int> footW(panels_.size()), footH(panels_.size());
+    std::vector<int> colX(cols_ + 1, 0), rowY(rows_ + 1, 0);
+    for (unsigned r=0; r < rows_; r++){
+        for (unsigned c=0; c < cols_; c++){
+            size_t p = c + r*cols_;
+            bool sideways = panels_[p].rotation == ROTATE_90 || panels_[p].rotation == ROTATE_270;
+            footW[p] = sideways ? panelH_ : panelW_;
+            footH[p] = sideways ? panelW_ : panelH_;
+            colX[c+1] = std::max(colX[c+1], footW[p]);
+            rowY[r+1] = std::max(rowY[r+1], footH[p]);
+        }
+    }
+    for (unsigned c=0; c < cols_; c++){
+        colX[c+1] += colX[c];
+    }
+    for (unsigned r=0; r < rows_; r++){
+        rowY[r+1] += rowY[r];
+    }
+
+    /* Second pass: find where every panel's footprint lands so the wall can be shifted to
+    start at (0,0) and sized to fit all of them. */
+    std::vector<int> originX(panels_.size()), originY(panels_.size());
+    int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+    for (unsigned r=0; r < rows_; r++){
+        for (unsigned c=0; c < cols_; c++){
+            size_t p = c + r*cols_;
+            originX[p] = colX[c] + panels_[p].offsetX;
+            originY[p] = rowY[r] + panels_[p].offsetY;
+            minX = std::min(minX, originX[p]);
+            minY = std::min(minY, originY[p]);
+            maxX = std::max(maxX, originX[p] + footW[p]);
+            maxY = std::max(maxY, originY[p] + footH[p]);
+        }
+    }
+    wallW_ = maxX - minX;
+    wallH_ = maxY - minY;
+
+    /* Third pass: map each LED of each panel (in the panel's native orientation) to the
+    wall pixel it displays. This is what makes packing a straight gather. */
+    size_t ledsPerPanel = panelW_*panelH_;
+    ledMap_.resize(panels_.size()*ledsPerPanel);
+    for (size_t p=0; p < panels_.size(); p++){
+        PanelRotation rot = panels_[p].rotation;
+        for (unsigned y=0; y < panelH_; y++){
+            for (unsigned x=0; x < panelW_; x++){
+                unsigned fx, fy; // position inside the panel's footprint on the wall
+                if (rot == ROTATE_0){
+                    fx = x, fy = y;
+                } else if (rot == ROTATE_90){
+                    fx = panelH_ - 1 - y, fy = x;
+                } else if (rot == ROTATE_180){
+                    fx = panelW_ - 1 - x, fy = panelH_ - 1 - y;
+                } else{
+                    fx = y, fy = panelW_ - 1 - x;
+                }
+                size_t wallX = originX[p] - minX + fx;
+                size_t wallY = originY[p] - minY + fy;
+                ledMap_[p*ledsPerPanel + x + y*panelW_] = wallX + wallY*wallW_;
+            }
+        }
+    }
+}
+
+/*@@@@@@@@@@@@@
+Panel packing
+@@@@@@@@@@@@@@@*/
+
+template <typename Work>
+void VideoWall::parallelFor(size_t count, Work work){
+    size_t threads = threads_ ? threads_ : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, count);
+    if (threads <= 1){
+        work((size_t) 0, count);
+        return;
+    }
+
+    /* Hand each thread a contiguous chunk. The calling thread takes the first one. */
+    std::vector<std::thread> workers;
+    size_t chunk = (count + threads - 1) / threads;
+    for (size_t begin = chunk; begin < count; begin += chunk){
+        size_t end = std::min(begin + chunk, count);
+        workers.emplace_back([&work, begin, end](){ work(begin, end); });
+    }
+    work((size_t) 0, std::min(chunk, count));
+    for (std::thread& t : workers){
+        t.join();
+    }
+}
+
+void VideoWall::packPanel(PNG& wallFrame, size_t panel, Pixel domColorA, Pixel domColorB, std::vector<u_int32_t>& result){
+    size_t ledsPerPanel = panelW_*panelH_;
+    result.assign((ledsPerPanel + 31) / 32, 0);
+
+    /* Same bit layout as Animation::frameToArduino: LED (x,y) is bit (x + y*panelW) counting
+    from the least significant bit of the first word. Ties go to A just like binarify. */
+    const size_t* map = &ledMap_[panel*ledsPerPanel];
+    for (size_t i=0; i < ledsPerPanel; i++){
+        Pixel& curr = wallFrame.getPixel(map[i] % wallW_, map[i] / wallW_);
+        if (squaredDistance(curr, domColorA) <= squaredDistance(curr, domColorB)){
+            result[i/32] |= (u_int32_t) 0x1 << i%32;
+        }
+    }
+}
+
+std::vector<std::vector<u_int32_t>> VideoWall::frameToWall(PNG myFrame, Pixel domColorA, Pixel domColorB){
+    /* Scale once for the whole wall rather than once per panel. Packing a single frame is a
+    gather of a few thousand pixels, cheaper than starting threads, so it stays on this one. */
+    myFrame.scale(wallW_, wallH_);
+
+    std::vector<std::vector<u_int32_t>> result(panels_.size());
+    for (size_t p=0; p < panels_.size(); p++){
+        packPanel(myFrame, p, domColorA, domColorB, result[p]);
+    }
+
+    return result;
+}
+
+std::vector<std::vector<std::vector<u_int32_t>>> VideoWall::animationToWall(Animation& anim){
+    size_t frameCount = anim.getFrameCount();
+    if (frameCount == 0){
+        throw std::runtime_error("VideoWall::animationToWall() ERROR: Cannot convert an empty animation.");
+    }
+
+    /* Split the frames between the threads. Each frame is scaled to the wall resolution and
+    packed by the same thread, then dropped, so only one scaled frame per thread is alive at
+    a time and the scaling runs in parallel too. The frames of the animation are left
+    untouched, and every frame writes to its own slots so no locking is needed. */
+    size_t panelCount = panels_.size();
+    std::vector<std::vector<std::vector<u_int32_t>>> streams(panelCount, std::vector<std::vector<u_int32_t>>(frameCount));
+    parallelFor(frameCount, [&](size_t begin, size_t end){
+        for (size_t f = begin; f < end; f++){
+            PNG wallFrame = anim.getFrame(f);
+            wallFrame.scale(wallW_, wallH_);
+            for (size_t p=0; p < panelCount; p++){
+                packPanel(wallFrame, p, BLACK, WHITE, streams[p][f]);
+            }
+        }
+    });
+
+    return streams;
+}
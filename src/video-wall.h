@@ -0,0 +1,144 @@
+#ifndef VIDEO_WALL_H
+#define VIDEO_WALL_H
+
+#include "arduino-animation.h"
+
+/* Orientation a panel is mounted at, measured clockwise from its native orientation. */
+enum PanelRotation{
+    ROTATE_0 = 0,
+    ROTATE_90 = 90,
+    ROTATE_180 = 180,
+    ROTATE_270 = 270
+};
+
+/* Placement information for a single panel of the wall. */
+struct PanelConfig{
+    PanelRotation rotation;
+    int offsetX; // extra horizontal shift in wall pixels, applied on top of the grid position
+    int offsetY; // extra vertical shift in wall pixels, applied on top of the grid position
+
+    /**
+     * Default PanelConfig constructor. Panels default to their native orientation
+     * sitting exactly in their grid cell.
+     * @param r The rotation of the panel.
+     * @param ox,oy The offset of the panel from its grid position.
+     */
+    PanelConfig(PanelRotation r = ROTATE_0, int ox = 0, int oy = 0) : rotation(r), offsetX(ox), offsetY(oy) {};
+};
+
+class VideoWall{
+    public:
+        /**
+         * Default constructor. Creates a wall of rows x cols panels, all in their
+         * native orientation with no offset.
+         * @param rows,cols The dimensions of the panel grid. Must be greater than 0.
+         * @param panelW,panelH The LED dimensions of a single panel. Defaults to the
+         * 12x8 matrix of the Arduino UNO R4.
+         */
+        VideoWall(unsigned rows, unsigned cols, unsigned panelW = 12, unsigned panelH = 8);
+
+        /**
+         * Changes the placement of a single panel. Wall dimensions are recomputed
+         * so that every panel still fits. Each grid column is as wide as the widest panel
+         * in it after rotation and each row as tall as the tallest, with panels placed at
+         * the top left of their cell, so rotated panels never need offsets to avoid
+         * overlapping. Offsets are only for fine adjustment.
+         * @param row,col The grid position of the panel. Must be in-bounds.
+         * @param config The new rotation and offset of the panel.
+         */
+        void setPanel(unsigned row, unsigned col, PanelConfig config);
+
+        /**
+         * Getter for a panel's placement.
+         * @param row,col The grid position of the panel. Must be in-bounds.
+         * @return The rotation and offset of the panel.
+         */
+        PanelConfig getPanel(unsigned row, unsigned col);
+
+        /**
+         * Width access operator.
+         * @return The width of the whole wall in LEDs.
+         */
+        unsigned getWidth();
+
+        /**
+         * Height access operator.
+         * @return The height of the whole wall in LEDs.
+         */
+        unsigned getHeight();
+
+        /**
+         * Number of panels on the wall.
+         * @return rows * cols
+         */
+        size_t getPanelCount();
+
+        /**
+         * Sets the number of worker threads animationToWall splits frames between. 0
+         * (the default) uses one thread per hardware core.
+         * @param threads The number of threads to use.
+         */
+        void setThreads(unsigned threads);
+
+        /**
+         * Converts a single frame to the state of every panel on the wall. The frame
+         * is scaled once to the wall resolution and then cut into panel tiles. Each LED
+         * is set if it is closer to domColorA than domColorB.
+         * @param myFrame The frame to be converted
+         * @param domColorA The LED ON color.
+         * @param domColorB The LED OFF color.
+         * @return One packed frame per panel in row-major panel order. Each packed frame
+         * has the same layout as Animation::frameToArduino.
+         */
+        std::vector<std::vector<u_int32_t>> frameToWall(PNG myFrame, Pixel domColorA = BLACK, Pixel domColorB = WHITE);
+
+        /**
+         * Converts an entire Animation to one frame stream per panel. The frames are
+         * split between the worker threads, which scale and pack one frame at a time.
+         * Function cannot be called on an empty animation.
+         * @return A vector indexed by [panel][frame], where each entry is the packed
+         * state of that panel's LEDs for that frame.
+         */
+        std::vector<std::vector<std::vector<u_int32_t>>> animationToWall(Animation& anim);
+
+    private:
+        unsigned rows_;
+        unsigned cols_;
+        unsigned panelW_;
+        unsigned panelH_;
+        unsigned wallW_;
+        unsigned wallH_;
+        unsigned threads_; // 0 means hardware concurrency
+        std::vector<PanelConfig> panels_; // row-major order
+
+        /* Precomputed wall pixel index for every LED of every panel. Entry
+        [p*panelW_*panelH_ + x + y*panelW_] is the wall pixel LED (x,y) of panel p shows. */
+        std::vector<size_t> ledMap_;
+
+        /**
+         * Private helper function that recomputes wallW_, wallH_ and ledMap_ after
+         * the layout changes.
+         */
+        void updateLayout();
+
+        /**
+         * Private helper function that packs one panel tile out of a frame that is
+         * already at wall resolution.
+         * @param wallFrame The frame scaled to getWidth() x getHeight().
+         * @param panel The row-major index of the panel to pack.
+         * @param domColorA, domColorB The LED ON and OFF colors.
+         * @param result Where the packed words are written. Will be resized.
+         */
+        void packPanel(PNG& wallFrame, size_t panel, Pixel domColorA, Pixel domColorB, std::vector<u_int32_t>& result);
+
+        /**
+         * Private helper function that splits [0, count) into contiguous chunks and
+         * runs work on each chunk in its own thread.
+         * @param count The number of work items.
+         * @param work Called as work(begin, end) for every chunk.
+         */
+        template <typename Work>
+        void parallelFor(size_t count, Work work);
+};
+
+#endif